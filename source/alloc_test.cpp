@@ -0,0 +1,301 @@
+// alloc_test
+//
+// Check that the steady-state packet paths never allocate memory: a million
+// simulated packets are pushed through each of them while malloc and
+// operator new are counting.
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <new>
+
+#include "shorthands.hpp"
+#include "packet_transmitter.hpp"
+#include "packet_receiver.hpp"
+#include "impairment.hpp"
+#include "flight_recorder.hpp"
+#include "link_statistic.hpp"
+#include "histogram.hpp"
+#include "timing_wheel.hpp"
+#include "packet_ring.hpp"
+#include "rng.hpp"
+
+using namespace std;
+
+extern "C"
+{
+  void *__libc_malloc(size_t);
+  void *__libc_calloc(size_t, size_t);
+  void *__libc_realloc(void *, size_t);
+  void __libc_free(void *);
+}
+
+// Only the thread running the paths counts, not background writers
+static thread_local bool counting = false;
+static uint64_t allocations = 0;
+
+extern "C" void *malloc(size_t n)
+{
+  if(counting) allocations ++;
+  return __libc_malloc(n);
+}
+
+extern "C" void *calloc(size_t n, size_t m)
+{
+  if(counting) allocations ++;
+  return __libc_calloc(n, m);
+}
+
+extern "C" void *realloc(void *p, size_t n)
+{
+  if(counting) allocations ++;
+  return __libc_realloc(p, n);
+}
+
+extern "C" void free(void *p)
+{
+  __libc_free(p);
+}
+
+void *operator new(size_t n)
+{
+  if(counting) allocations ++;
+  void *p = __libc_malloc(n ? n : 1);
+  if(!p) throw bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t n)
+{
+  return operator new(n);
+}
+
+void operator delete(void *p) noexcept { __libc_free(p); }
+void operator delete[](void *p) noexcept { __libc_free(p); }
+void operator delete(void *p, size_t) noexcept { __libc_free(p); }
+void operator delete[](void *p, size_t) noexcept { __libc_free(p); }
+
+enum
+{
+  warm_up  = 200000,  // Packets before counting, enough to fill every buffer once
+  packets  = 1000000, // Packets counted
+  max_size = 256,     // The paths checked do not depend on the packet size
+  flows    = 10000
+};
+
+static nat failures = 0;
+
+// Run step(i) for warm_up + packets values of i, counting allocations after warm_up
+template<typename F>
+static void check(const string& mode, F step)
+{
+  for(nat i = 0; i < warm_up; i ++) step(i);
+  allocations = 0;
+  counting = true;
+  for(nat i = warm_up; i < warm_up + packets; i ++) step(i);
+  counting = false;
+
+  cout << mode << ": " << allocations << " allocations in " << packets << " packets" << endl;
+  if(allocations > 0) failures ++;
+}
+
+static void check_transmitter(packet_log::format format, const string& name,
+                              payload_integrity integrity=integrity_pattern)
+{
+  packet_transmitter tx(packet_log::create(format, log_tx, "/dev/null"), integrity);
+  link_statistic stat(10000, 10000);
+  vector<char> buf(max_size);
+  fast_rng g(1, 1);
+
+  check("tx " + name, [&](nat)
+  {
+    const size_t size = 1 + g.below(max_size);
+    tx.transmit(buf.data(), size);
+    stat.add(size);
+  });
+}
+
+// Build packets into a ring and take them out in batches, in one thread
+static void check_pipeline()
+{
+  packet_transmitter tx(packet_log::create(packet_log::text, log_tx, "/dev/null"));
+  packet_ring ring(64, max_size);
+  fast_rng g(5, 1);
+
+  check("tx pipeline", [&](nat i)
+  {
+    packet_ring::slot *s = ring.back();
+    s->size = 1 + g.below(max_size);
+    s->t = 1000 * int64_t(i);
+    s->seq = tx.get_sequence();
+    tx.transmit_at(s->data, s->size, i);
+    ring.push();
+    if(ring.available() == ring.capacity()) ring.pop(1 + g.below(ring.capacity()));
+  });
+}
+
+// Feed a receiver with packets lost, duplicated, reordered, damaged and
+// truncated now and then
+static void check_receiver(packet_log::format format, const verify_mode& verify,
+                           payload_integrity integrity=integrity_pattern, const log_mode& mode=log_mode(),
+                           bool recorder=false)
+{
+  packet_log::ptr log = packet_log::create(format, log_rx, "/dev/null", mode);
+  if(recorder)
+  {
+    // Every simulated loss and error triggers the recorder, until it stops dumping
+    flight_recorder_settings settings;
+    settings.before = 1000;
+    settings.after = 100;
+    settings.loss_burst = 1;
+    log.reset(new flight_recorder(log, log_rx, "alloc_test.rxl", settings));
+  }
+  packet_receiver::ptr rx = packet_receiver::create(log, 50, verify, integrity);
+  link_statistic stat(10000, 10000);
+  vector<char> buf(max_size), held(max_size);
+  size_t held_size = 0;
+  uint32_t seq = 0;
+  fast_rng g(2, 1);
+
+  check(string("rx ") + (mode.bin_interval > 0 ? "bins " : format == packet_log::text ? "text " : "compressed ") +
+        verify.name() + " " + payload_integrity_name(integrity) + (recorder ? " flight recorder" : ""), [&](nat)
+  {
+    const size_t size = packet_header::encoded_size + g.below(max_size - packet_header::encoded_size);
+    packet_transmitter::encode(buf.data(), size, seq ++, 0, integrity);
+
+    const double u = g.uniform();
+    if(u < 0.001) return;                                       // Lost
+    if(u < 0.002) buf[size - 1] ^= 1;                           // Bit error
+    if(u < 0.003) buf[0] ^= 1;                                  // Bad header
+    const size_t m = u < 0.004 ? size - 1 : size;               // Truncated
+
+    if(u < 0.005 && held_size == 0)                             // Delayed by one packet
+    {
+      memcpy(held.data(), buf.data(), m);
+      held_size = m;
+      return;
+    }
+
+    rx->receive(buf.data(), m);
+    stat.add(m);
+    if(u < 0.006) rx->receive(buf.data(), m);                   // Duplicated
+    if(held_size > 0)
+    {
+      rx->receive(held.data(), held_size);
+      held_size = 0;
+    }
+  });
+
+  if(recorder)
+  {
+    // Wait for the last dump, then clean up
+    rx.reset();
+    log.reset();
+    for(nat k = 1; k <= flight_recorder::max_dumps; k ++) remove(("alloc_test.rxl.flight-" + to_string(k)).c_str());
+  }
+}
+
+// Impair packets with every stage, reordering by position or by time
+static void check_impairment(const string& reorder)
+{
+  impairment_settings settings;
+  settings.loss = gilbert_elliott::parse("0.01,0.3,1,0.001");
+  settings.reorder = reorder_model::parse(reorder);
+  settings.p_duplicate = 0.01;
+  settings.corrupt = corruption_model::parse("0.01,3");
+  impairment impair(settings, fast_rng(5, 1), max_size, "/dev/null");
+  vector<char> buf(max_size);
+  uint64_t emitted = 0;
+  auto emit = [&emitted](char *, size_t) { emitted ++; };
+  fast_rng g(6, 1);
+
+  check("impairment " + reorder, [&](nat i)
+  {
+    const size_t size = 1 + g.below(max_size);
+    const int64_t t = 1000 * int64_t(i);
+    if(size >= packet_header::encoded_size) packet_transmitter::encode(buf.data(), size, i, t);
+    impair.begin_batch();
+    impair.release(t, emit);
+    impair.apply(buf.data(), size, t, emit);
+  });
+}
+
+static void check_flows()
+{
+  timing_wheel wheel(flows, 1000);
+  vector<int64_t> next_t(flows), gap(flows);
+  vector<uint32_t> due;
+  due.reserve(flows);
+  vector<char> buf(max_size);
+  fast_rng g(3, 1);
+
+  for(nat f = 0; f < flows; f ++)
+  {
+    gap[f] = 1000 * (1 + g.below(100000));
+    next_t[f] = g.below(gap[f]);
+    wheel.schedule(f, next_t[f]);
+  }
+
+  int64_t t = 0;
+  check("flows", [&](nat)
+  {
+    // One packet per step, as far as the wheel is concerned
+    while(due.empty())
+    {
+      t = max(t, wheel.next_expiry());
+      wheel.advance(t, [&due](uint32_t f) { due.push_back(f); });
+    }
+    const uint32_t f = due.back();
+    due.pop_back();
+    packet_transmitter::encode(buf.data(), 64, f, t);
+    next_t[f] += gap[f];
+    wheel.schedule(f, next_t[f]);
+  });
+}
+
+int main()
+{
+  check_transmitter(packet_log::text, "text");
+  check_transmitter(packet_log::compressed, "compressed");
+  check_transmitter(packet_log::text, "text crc32c", integrity_crc32c);
+  check_pipeline();
+
+  const verify_mode modes[] =
+  {
+    verify_mode(verify_mode::none),
+    verify_mode(verify_mode::header),
+    verify_mode(verify_mode::sampled, 10),
+    verify_mode(verify_mode::full)
+  };
+  for(size_t k = 0; k < sizeof(modes) / sizeof(*modes); k ++)
+  {
+    check_receiver(packet_log::text, modes[k]);
+    check_receiver(packet_log::compressed, modes[k]);
+  }
+  check_receiver(packet_log::text, verify_mode(verify_mode::full), integrity_crc32c);
+  check_receiver(packet_log::text, verify_mode(verify_mode::full), integrity_pattern, log_mode(1000));
+  check_receiver(packet_log::text, verify_mode(verify_mode::full), integrity_pattern, log_mode(), true);
+
+  check_impairment("0.01,5");
+  check_impairment("0.01,20us");
+  check_flows();
+
+  {
+    histogram h;
+    fast_rng g(4, 1);
+    check("histogram", [&](nat) { h.add(g.below(1000000)); });
+  }
+
+  if(failures > 0)
+  {
+    cout << failures << " paths allocate" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+// control_channel.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef CONTROL_CHANNEL_HPP_20261019
+#define CONTROL_CHANNEL_HPP_20261019
+
+#include <string>
+#include <istream>
+#include <stdexcept>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include "shorthands.hpp"
+
+// The control channel is a TCP connection from the transmitter to the
+// receiver carrying one command per line, each answered by one line:
+//
+//   start        ->  ok                  Start counting packets for a trial
+//   stop         ->  received N          Stop the trial, N decodables received
+//
+// Unknown commands are answered with "error ...".
+
+/// \brief Receiver side of the control channel, served from the io_service.
+class control_server
+{
+public:
+  /// Map a command line to its reply line, both without the newline.
+  typedef boost::function<std::string(const std::string&)> handler;
+
+private:
+  class session : public boost::enable_shared_from_this<session>
+  {
+    boost::asio::ip::tcp::socket socket;
+    boost::asio::streambuf input;
+    std::string reply;
+    handler h;
+
+  public:
+    session(boost::asio::io_service& io, handler h_) : socket(io), h(h_) { }
+
+    boost::asio::ip::tcp::socket& get_socket() { return socket; }
+
+    void read()
+    {
+      boost::asio::async_read_until(socket, input, '\n',
+        boost::bind(&session::handle_read, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handle_read(const boost::system::error_code& ec)
+    {
+      if(ec) return; // Connection closed, the session goes away
+
+      std::istream in(&input);
+      std::string command;
+      std::getline(in, command);
+      if(!command.empty() && command[command.size() - 1] == '\r') command.erase(command.size() - 1);
+
+      reply = h(command) + "\n";
+      boost::asio::async_write(socket, boost::asio::buffer(reply),
+        boost::bind(&session::handle_write, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handle_write(const boost::system::error_code& ec)
+    {
+      if(!ec) read();
+    }
+  };
+
+  boost::asio::io_service& io;
+  boost::asio::ip::tcp::acceptor acceptor;
+  handler h;
+
+  void accept()
+  {
+    boost::shared_ptr<session> s(new session(io, h));
+    acceptor.async_accept(s->get_socket(),
+      boost::bind(&control_server::handle_accept, this, s, boost::asio::placeholders::error));
+  }
+
+  void handle_accept(boost::shared_ptr<session> s, const boost::system::error_code& ec)
+  {
+    if(ec == boost::asio::error::operation_aborted) return;
+    if(!ec) s->read();
+    accept();
+  }
+
+public:
+  control_server(boost::asio::io_service& io_, const boost::asio::ip::tcp::endpoint& local, handler h_) :
+    io(io_),
+    acceptor(io, local),
+    h(h_)
+  {
+    accept();
+  }
+};
+
+/// \brief Transmitter side of the control channel, blocking.
+class control_client
+{
+  boost::asio::ip::tcp::socket socket;
+  boost::asio::streambuf input;
+
+public:
+  control_client(boost::asio::io_service& io, const boost::asio::ip::tcp::endpoint& remote) :
+    socket(io)
+  {
+    socket.connect(remote);
+  }
+
+  /// Send a command and return the reply, throwing runtime_error if it is an error.
+  std::string call(const std::string& command)
+  {
+    boost::asio::write(socket, boost::asio::buffer(command + "\n"));
+    boost::asio::read_until(socket, input, '\n');
+    std::istream in(&input);
+    std::string reply;
+    std::getline(in, reply);
+    if(reply.compare(0, 5, "error") == 0) throw std::runtime_error("Receiver replied: " + reply);
+    return reply;
+  }
+};
+
+#endif
@@ -0,0 +1,116 @@
+// crc32c.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <endian.h>
+
+#if defined(__x86_64__)
+  #include <nmmintrin.h>
+#endif
+
+#include "crc32c.hpp"
+
+namespace
+{
+  const uint32_t polynomial = 0x82f63b78; // Castagnoli, reflected
+
+  // t[k][b] is the CRC of byte b followed by k zero bytes, so that eight
+  // bytes can be folded in with eight independent lookups.
+  struct slicing_tables
+  {
+    uint32_t t[8][256];
+
+    slicing_tables()
+    {
+      for(uint32_t b = 0; b < 256; b ++)
+      {
+        uint32_t c = b;
+        for(int i = 0; i < 8; i ++) c = (c >> 1) ^ (polynomial & -(c & 1));
+        t[0][b] = c;
+      }
+      for(int k = 1; k < 8; k ++)
+      {
+        for(int b = 0; b < 256; b ++) t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+      }
+    }
+  };
+
+  const slicing_tables tables;
+
+  uint32_t crc32c_slicing(const unsigned char *p, size_t n, uint32_t crc)
+  {
+    const uint32_t (*t)[256] = tables.t;
+
+    for(; n > 0 && (reinterpret_cast<uintptr_t>(p) & 7); n --)
+      crc = t[0][(crc ^ *p ++) & 0xff] ^ (crc >> 8);
+
+    for(; n >= 8; n -= 8, p += 8)
+    {
+      uint64_t w;
+      memcpy(&w, p, sizeof(w));
+      w = le64toh(w) ^ crc;
+      crc = t[7][ w        & 0xff] ^ t[6][(w >>  8) & 0xff] ^
+            t[5][(w >> 16) & 0xff] ^ t[4][(w >> 24) & 0xff] ^
+            t[3][(w >> 32) & 0xff] ^ t[2][(w >> 40) & 0xff] ^
+            t[1][(w >> 48) & 0xff] ^ t[0][ w >> 56        ];
+    }
+
+    for(; n > 0; n --) crc = t[0][(crc ^ *p ++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+  }
+
+#if defined(__x86_64__)
+  __attribute__((target("sse4.2")))
+  uint32_t crc32c_sse42(const unsigned char *p, size_t n, uint32_t crc)
+  {
+    uint64_t c = crc;
+
+    for(; n > 0 && (reinterpret_cast<uintptr_t>(p) & 7); n --) c = _mm_crc32_u8(c, *p ++);
+
+    for(; n >= 8; n -= 8, p += 8)
+    {
+      uint64_t w;
+      memcpy(&w, p, sizeof(w));
+      c = _mm_crc32_u64(c, w);
+    }
+
+    for(; n > 0; n --) c = _mm_crc32_u8(c, *p ++);
+
+    return c;
+  }
+#endif
+
+  typedef uint32_t (*crc32c_function)(const unsigned char *, size_t, uint32_t);
+
+  struct implementation
+  {
+    crc32c_function f;
+    const char *name;
+
+    implementation() : f(crc32c_slicing), name("slicing-by-8")
+    {
+#if defined(__x86_64__)
+      if(__builtin_cpu_supports("sse4.2"))
+      {
+        f = crc32c_sse42;
+        name = "sse4.2";
+      }
+#endif
+    }
+  };
+
+  const implementation selected;
+}
+
+uint32_t crc32c(const void *data, size_t n, uint32_t crc)
+{
+  return ~selected.f(static_cast<const unsigned char *>(data), n, ~crc);
+}
+
+const char *crc32c_implementation()
+{
+  return selected.name;
+}
@@ -0,0 +1,23 @@
+// crc32c.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef CRC32C_HPP_20261019
+#define CRC32C_HPP_20261019
+
+#include <cstddef>
+#include <stdint.h>
+
+/// Size of the CRC32C trailer appended to payloads with --integrity crc32c.
+enum { crc32c_size = 4 };
+
+/// Compute the CRC32C (Castagnoli) of n bytes, continuing from a previous
+/// value crc.  Uses the SSE4.2 crc32 instruction when the processor has it,
+/// and slicing-by-8 tables otherwise.
+uint32_t crc32c(const void *data, size_t n, uint32_t crc=0);
+
+/// Name of the implementation selected for this processor.
+const char *crc32c_implementation();
+
+#endif
@@ -3,6 +3,9 @@
 // Author: Berke Durak <berke.durak@gmail.com>
 // vim:set ts=2 sw=2 foldmarker={,}:
 
+#include <string.h>
+#include <arpa/inet.h>
+
 #include "curx.h"
 
 static inline uint32_t curx_wprng_rol32(uint32_t x, uint32_t y)
@@ -41,25 +44,23 @@ static uint32_t curx_wprng_get(struct curx_wprng *g)
   return g->a;
 }
 
-static void curx_ph_show(struct curx_ph *h)
-{
-  curx_printf("PH %u %u %u %u", h->sequence, h->timestamp, h->size, h->check);
-}
-
-static void curx_ph_fix_endianness(struct curx_ph *h)
+/* Decode a header from the start of a packet without modifying the packet,
+ * which need not be aligned. */
+static inline void curx_ph_decode(struct curx_ph *h, const char *buffer)
 {
+  memcpy(h, buffer, sizeof(*h));
   h->sequence  = ntohl(h->sequence);
   h->timestamp = ntohl(h->timestamp);
   h->size      = ntohs(h->size);
   h->check     = ntohs(h->check);
 }
 
-static uint16_t curx_ph_get_checksum(struct curx_ph *h)
+static inline uint16_t curx_ph_get_checksum(const struct curx_ph *h)
 {
   return ~(h->sequence ^ h->size ^ h->timestamp);
 }
 
-static int curx_ph_checksum_valid(struct curx_ph *h)
+static inline int curx_ph_checksum_valid(const struct curx_ph *h)
 {
   return curx_ph_get_checksum(h) == h->check;
 }
@@ -190,9 +191,9 @@ enum curx_status curx_receive(struct curx_state *q, const char *buffer, const si
   uint32_t errors = 0;
   unsigned int i;
   size_t m = m0;
-  struct curx_ph *ph;
+  struct curx_ph ph;
   struct curx_wprng *w = &q->rng;
-  char *p;
+  const char *p;
 
   do
   {
@@ -202,17 +203,15 @@ enum curx_status curx_receive(struct curx_state *q, const char *buffer, const si
       break;
     }
 
-    ph = (struct curx_ph *) buffer;
-    curx_ph_fix_endianness(ph);
-    curx_ph_show(ph);
-    if(!curx_ph_checksum_valid(ph))
+    curx_ph_decode(&ph, buffer);
+    if(!curx_ph_checksum_valid(&ph))
     {
       status = CURX_BAD;
       q->bad_checksum ++;
       break;
     }
 
-    seq = ph->sequence;
+    seq = ph.sequence;
     if(!q->count || seq < q->seq_min) q->seq_min = seq;
     if(!q->count || seq > q->seq_max) q->seq_max = seq;
     if(q->count && seq < q->seq_last)
@@ -235,11 +234,11 @@ enum curx_status curx_receive(struct curx_state *q, const char *buffer, const si
         );
     }
 
-    curx_wprng_init(w, ph->check);
+    curx_wprng_init(w, ph.check);
 
     m -= sizeof(struct curx_ph);
 
-    if(ph->size != m)
+    if(ph.size != m)
     {
       q->truncated ++;
       status |= CURX_TRUNC;
@@ -248,7 +247,7 @@ enum curx_status curx_receive(struct curx_state *q, const char *buffer, const si
 
     q->decodable_count ++;
 
-    p = (char *) (ph + 1);
+    p = buffer + sizeof(struct curx_ph);
 
     for(i = 0; i < m; i ++)
     {
@@ -272,5 +271,18 @@ enum curx_status curx_receive(struct curx_state *q, const char *buffer, const si
   q->count ++;
 
   return status;
-  /* log << t_rx << " " << m0 << " " << status << " " << seq << " " << t_tx << " " << errors << "\n";*/
+}
+
+void curx_receive_batch(struct curx_state *q, const char *const *buffers, const size_t *lengths, size_t n,
+                        enum curx_status *statuses)
+{
+  size_t i;
+
+  for(i = 0; i < n && i < CURX_PREFETCH_DISTANCE; i ++) __builtin_prefetch(buffers[i]);
+
+  for(i = 0; i < n; i ++)
+  {
+    if(i + CURX_PREFETCH_DISTANCE < n) __builtin_prefetch(buffers[i + CURX_PREFETCH_DISTANCE]);
+    statuses[i] = curx_receive(q, buffers[i], lengths[i]);
+  }
 }
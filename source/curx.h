@@ -72,12 +72,34 @@ struct curx_state
 
 void curx_init(struct curx_state *q, void (*output_missing_hook)(void *, uint32_t, uint32_t, uint32_t), void *hook_data);
 
-/* q      - properly initialized state
- * data   - Pointer to UDP payload data
- * length - Size of UDP payload
+/* Number of packets ahead of the current one whose headers curx_receive_batch
+ * prefetches */
+#ifndef CURX_PREFETCH_DISTANCE
+  #define CURX_PREFETCH_DISTANCE 4
+#endif
+
+/* Process one packet.  The buffer is not modified and need not be aligned.
+ *
+ * q      - properly initialized state
+ * buffer - Pointer to UDP payload data
+ * m0     - Size of UDP payload
+ *
+ * Returns a bitmask of curx_status values.
  */
 enum curx_status curx_receive(struct curx_state *q, const char *buffer, const size_t m0);
 
+/* Process n packets in order, as if by calling curx_receive on each one, while
+ * prefetching the following packets.
+ *
+ * q        - properly initialized state
+ * buffers  - Pointers to the UDP payloads
+ * lengths  - Sizes of the UDP payloads
+ * n        - Number of packets
+ * statuses - Receives the status bitmask of each packet
+ */
+void curx_receive_batch(struct curx_state *q, const char *const *buffers, const size_t *lengths, size_t n,
+                        enum curx_status *statuses);
+
 #define CURX_STATUS_FORMAT "{%s%s%s%s%s%s }"
 #define CURX_STATUS_FORMAT_PADDED "{%6s%6s%6s%6s%6s%6s }"
 #define CURX_STATUS_ARGS(status) \
@@ -1,5 +1,6 @@
 /* curx_test.c */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -10,6 +11,8 @@
 #include <netinet/in.h>
 #include "curx.h"
 
+#define BATCH 32
+
 #define avoid(x, msg, args...) \
   do { \
     if( x ) \
@@ -47,10 +50,14 @@ int main(int argc, char **argv)
 {
    int s;
    const int port = 33333;
-   struct sockaddr_in sin, sin_old;
-   char data[1500];
-   ssize_t m;
-   socklen_t sin_len;
+   struct sockaddr_in sin, sin_old, sins[BATCH];
+   static char data[BATCH][1500];
+   struct iovec iov[BATCH];
+   struct mmsghdr msgs[BATCH];
+   const char *buffers[BATCH];
+   size_t lengths[BATCH];
+   enum curx_status statuses[BATCH];
+   int i, j, n;
    struct curx_state cx;
    int count = 0;
    bool have_sin_old = false;
@@ -82,29 +89,52 @@ int main(int argc, char **argv)
    sin.sin_port = htons(port);
    avoid(bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0, "Can't bind to port %d", port);
 
-   while(true)
+   for(i = 0; i < BATCH; i ++)
    {
-      m = sizeof(data);
-      sin_len = sizeof(sin);
-      m = recvfrom(s, data, sizeof(data), 0, (struct sockaddr *) &sin, &sin_len);
-      avoid(m < 0, "Error receiving on socket");
-      count ++;
+      iov[i].iov_base = data[i];
+      iov[i].iov_len = sizeof(data[i]);
+      buffers[i] = data[i];
+   }
 
-      if(!have_sin_old || sin.sin_addr.s_addr != sin_old.sin_addr.s_addr || sin.sin_port != sin_old.sin_port)
+   while(true)
+   {
+      for(i = 0; i < BATCH; i ++)
       {
-         if(have_sin_old) display();
-         curx_init(&cx, output_missing, NULL);
-         memcpy(&sin_old, &sin, sizeof(sin_old));
-         have_sin_old = true;
-         printf("Receiving from %x:%d\n", ntohl(sin.sin_addr.s_addr), ntohs(sin.sin_port));
+         memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+         msgs[i].msg_hdr.msg_name = &sins[i];
+         msgs[i].msg_hdr.msg_namelen = sizeof(sins[i]);
+         msgs[i].msg_hdr.msg_iov = &iov[i];
+         msgs[i].msg_hdr.msg_iovlen = 1;
       }
+      n = recvmmsg(s, msgs, BATCH, MSG_WAITFORONE, NULL);
+      avoid(n < 0, "Error receiving on socket");
 
-      /* printf("Received %d bytes on socket:\n", m);
-         display_packet(data, m); */
-      curx_receive(&cx, data, m);
-      if(count % 1000 == 0)
+      /* Process runs of packets from the same source as batches */
+      for(i = 0; i < n; i = j)
       {
-         display();
+         memcpy(&sin, &sins[i], sizeof(sin));
+         if(!have_sin_old || sin.sin_addr.s_addr != sin_old.sin_addr.s_addr || sin.sin_port != sin_old.sin_port)
+         {
+            if(have_sin_old) display();
+            curx_init(&cx, output_missing, NULL);
+            memcpy(&sin_old, &sin, sizeof(sin_old));
+            have_sin_old = true;
+            printf("Receiving from %x:%d\n", ntohl(sin.sin_addr.s_addr), ntohs(sin.sin_port));
+         }
+
+         for(j = i; j < n && sins[j].sin_addr.s_addr == sin.sin_addr.s_addr && sins[j].sin_port == sin.sin_port; j ++)
+         {
+            lengths[j] = msgs[j].msg_len;
+            /* printf("Received %u bytes on socket:\n", msgs[j].msg_len);
+               display_packet(data[j], msgs[j].msg_len); */
+         }
+         curx_receive_batch(&cx, buffers + i, lengths + i, j - i, statuses + i);
+
+         for(; i < j; i ++)
+         {
+            count ++;
+            if(count % 1000 == 0) display();
+         }
       }
    }
 
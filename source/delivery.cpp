@@ -0,0 +1,109 @@
+// delivery.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <algorithm>
+#include <iomanip>
+#include <sys/socket.h>
+
+#include "delivery.hpp"
+
+using namespace std;
+
+#ifndef SO_INCOMING_CPU
+  #define SO_INCOMING_CPU 49
+#endif
+
+#ifndef SO_INCOMING_NAPI_ID
+  #define SO_INCOMING_NAPI_ID 56
+#endif
+
+enum
+{
+  max_listed = 8 // CPUs and NAPI ids listed, the busiest first
+};
+
+void delivery::sample(int fd, int& cpu, uint32_t& napi_id)
+{
+  socklen_t length = sizeof(cpu);
+  if(getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length)) cpu = -1;
+  length = sizeof(napi_id);
+  if(getsockopt(fd, SOL_SOCKET, SO_INCOMING_NAPI_ID, &napi_id, &length)) napi_id = 0;
+}
+
+void delivery::add(int cpu, uint32_t napi_id, int reader_cpu, uint64_t n)
+{
+  if(cpu >= 0)
+  {
+    if(size_t(cpu) >= cpus.size()) cpus.resize(cpu + 1, 0);
+    cpus[cpu] += n;
+    if(cpu == reader_cpu) local += n;
+  }
+  napi[napi_id] += n;
+  packets += n;
+}
+
+void delivery::clear()
+{
+  cpus.assign(cpus.size(), 0);
+  napi.clear();
+  packets = 0;
+  local = 0;
+}
+
+int delivery::busiest(uint64_t& n) const
+{
+  int cpu = -1;
+  n = 0;
+  for(size_t c = 0; c < cpus.size(); c ++)
+  {
+    if(cpus[c] > n)
+    {
+      n = cpus[c];
+      cpu = c;
+    }
+  }
+  return cpu;
+}
+
+// Write "label key share%" for the busiest keys of a distribution
+static void write_shares(ostream& out, const char *label, vector< pair<uint64_t, uint64_t> >& shares, uint64_t total)
+{
+  sort(shares.rbegin(), shares.rend());
+  for(size_t k = 0; k < shares.size() && k < max_listed; k ++)
+  {
+    out << (k ? ", " : "") << label << " " << shares[k].second << " " << 100.0 * shares[k].first / total << "%";
+  }
+  if(shares.size() > max_listed) out << ", " << shares.size() - max_listed << " more";
+}
+
+ostream& operator<<(ostream& out, const delivery& self)
+{
+  if(self.packets == 0) return out << "no packets";
+
+  out << fixed << setprecision(1);
+  vector< pair<uint64_t, uint64_t> > shares;
+  uint64_t known = 0;
+  for(size_t c = 0; c < self.cpus.size(); c ++)
+  {
+    if(self.cpus[c] == 0) continue;
+    shares.push_back(make_pair(self.cpus[c], c));
+    known += self.cpus[c];
+  }
+  if(shares.empty()) out << "CPU unknown";
+  else write_shares(out, "CPU", shares, self.packets);
+  const bool cpus_known = !shares.empty();
+
+  shares.clear();
+  for(map<uint32_t, uint64_t>::const_iterator it = self.napi.begin(); it != self.napi.end(); ++ it)
+    if(it->first != 0) shares.push_back(make_pair(it->second, it->first));
+  out << "; ";
+  if(shares.empty()) out << "no NAPI";
+  else write_shares(out, "NAPI", shares, self.packets);
+
+  if(cpus_known) out << "; " << 100.0 * self.local / known << "% read on the delivering CPU";
+  out.unsetf(ios::floatfield);
+  out << setprecision(6);
+  return out;
+}
@@ -0,0 +1,50 @@
+// delivery.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef DELIVERY_HPP_20261019
+#define DELIVERY_HPP_20261019
+
+#include <iostream>
+#include <vector>
+#include <map>
+
+#include "shorthands.hpp"
+
+/// \brief Distribution of received packets over the CPUs and NAPI instances
+/// that delivered them to a socket.
+///
+/// The kernel only tells the CPU (SO_INCOMING_CPU) and NAPI id
+/// (SO_INCOMING_NAPI_ID) of the last packet queued to a socket, so the socket
+/// is sampled after each batch read from it and the whole batch is counted for
+/// that CPU and NAPI id.  NAPI id 0 means none, as on the loopback interface.
+/// Packets are also counted as local when the reading thread ran on the
+/// delivering CPU.  Kernels that do not record the CPU report -1, and the
+/// packets are then counted for no CPU.
+class delivery
+{
+  std::vector<uint64_t> cpus;           // Packets per delivering CPU
+  std::map<uint32_t, uint64_t> napi;    // Packets per NAPI id
+  uint64_t packets, local;
+
+public:
+  delivery() : packets(0), local(0) { }
+
+  /// Read the delivering CPU, or -1, and NAPI id, or 0, of the last packet queued to a socket.
+  static void sample(int fd, int& cpu, uint32_t& napi_id);
+
+  /// Count n packets delivered by cpu and napi_id and read on reader_cpu.
+  void add(int cpu, uint32_t napi_id, int reader_cpu, uint64_t n);
+
+  void clear();
+
+  uint64_t get_packets() const { return packets; }
+
+  /// Return the CPU that delivered the most packets, or -1, and its packets.
+  int busiest(uint64_t& n) const;
+
+  friend std::ostream& operator<<(std::ostream& out, const delivery& self);
+};
+
+#endif
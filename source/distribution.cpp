@@ -0,0 +1,168 @@
+// distribution.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "distribution.hpp"
+
+using namespace std;
+
+void dirac::fill(fast_rng& g, double *x, size_t n)
+{
+  for(size_t i = 0; i < n; i ++) x[i] = x0;
+}
+
+void uniform::fill(fast_rng& g, double *x, size_t n)
+{
+  const double d = x1 - x0;
+  for(size_t i = 0; i < n; i ++) x[i] = x0 + d * g.uniform();
+}
+
+void exponential::fill(fast_rng& g, double *x, size_t n)
+{
+  for(size_t i = 0; i < n; i ++) x[i] = g.uniform();
+  for(size_t i = 0; i < n; i ++) x[i] = -mu * log1p(-x[i]);
+}
+
+empirical::empirical(const vector<double>& values_, const vector<double>& weights) :
+  values(values_),
+  prob(values_.size()),
+  alias(values_.size()),
+  mu(0)
+{
+  const size_t n = values.size();
+  double total = 0;
+
+  if(n == 0 || weights.size() != n) throw bad_parameters();
+  for(size_t i = 0; i < n; i ++)
+  {
+    if(weights[i] < 0) throw bad_parameters();
+    total += weights[i];
+  }
+  if(total <= 0) throw bad_parameters();
+
+  vector<double> scaled(n);
+  vector<uint32_t> small, large;
+
+  for(size_t i = 0; i < n; i ++)
+  {
+    mu += values[i] * weights[i] / total;
+    scaled[i] = weights[i] * n / total;
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+
+  while(!small.empty() && !large.empty())
+  {
+    const uint32_t s = small.back(), l = large.back();
+    small.pop_back();
+    prob[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] -= 1 - scaled[s];
+    if(scaled[l] < 1)
+    {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // Whatever remains has probability one, up to rounding errors
+  for(size_t i = 0; i < large.size(); i ++) { prob[large[i]] = 1; alias[large[i]] = large[i]; }
+  for(size_t i = 0; i < small.size(); i ++) { prob[small[i]] = 1; alias[small[i]] = small[i]; }
+}
+
+distribution::ptr empirical::load(const string& file)
+{
+  ifstream in(file.c_str());
+  if(!in) throw runtime_error("Cannot open histogram file " + file);
+
+  vector<double> values, weights;
+  string line;
+  nat line_number = 0;
+
+  while(getline(in, line))
+  {
+    line_number ++;
+    size_t i = line.find('#');
+    if(i != string::npos) line.erase(i);
+    stringstream ls(line);
+    double value, weight;
+    if(!(ls >> value)) continue;
+    ls >> weight;
+    if(ls.fail() || !(ls >> ws).eof() || weight < 0)
+    {
+      stringstream u;
+      u << file << ":" << line_number << ": Expected a value and a weight";
+      throw runtime_error(u.str());
+    }
+    values.push_back(value);
+    weights.push_back(weight);
+  }
+
+  try
+  {
+    return ptr(new empirical(values, weights));
+  }
+  catch(bad_parameters&)
+  {
+    throw runtime_error("Histogram " + file + " is empty or has no positive weight");
+  }
+}
+
+distribution::ptr empirical::imix(const string& name)
+{
+  // UDP payload sizes, that is IP packet sizes minus 28 bytes of IP and UDP
+  // headers, or Ethernet frame sizes minus 46 bytes
+  if(name == "simple")
+  {
+    // 7:4:1 of 40, 576 and 1500 byte IP packets
+    static const double v[] = { 12, 548, 1472 }, w[] = { 7, 4, 1 };
+    return ptr(new empirical(vector<double>(v, v + 3), vector<double>(w, w + 3)));
+  }
+  else if(name == "tolly")
+  {
+    // 55:5:17:23 of 64, 78, 576 and 1518 byte Ethernet frames
+    static const double v[] = { 18, 32, 530, 1472 }, w[] = { 55, 5, 17, 23 };
+    return ptr(new empirical(vector<double>(v, v + 4), vector<double>(w, w + 4)));
+  }
+  throw bad_parameters();
+}
+
+distribution::ptr distribution::parse(const string& u)
+{
+  size_t i0 = u.find(':');
+  string kind = "dirac";
+  if(i0 == string::npos)
+  {
+    // Assume Dirac by default
+    i0 = -1;
+  }
+  else
+  {
+    kind = u.substr(0, i0);
+  }
+  const string param_s = u.substr(i0 + 1);
+  stringstream param(param_s);
+
+  try
+  {
+    if(kind == "dirac")            return ptr(new dirac(param));
+    else if(kind == "uniform")     return ptr(new uniform(param));
+    else if(kind == "exponential") return ptr(new exponential(param));
+    else if(kind == "pareto")      return ptr(new pareto(param));
+    else if(kind == "lognormal")   return ptr(new lognormal(param));
+    else if(kind == "imix")        return empirical::imix(param_s);
+    else if(kind == "empirical")   return empirical::load(param_s);
+  }
+  catch(bad_parameters&)
+  {
+    throw runtime_error("Bad " + kind + " distribution description");
+  }
+
+  string e = "Unknown distribution kind ";
+  e += kind;
+  throw runtime_error(e);
+}
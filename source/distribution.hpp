@@ -0,0 +1,173 @@
+// distribution.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef DISTRIBUTION_HPP_20261019
+#define DISTRIBUTION_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "rng.hpp"
+
+/// \brief Random distribution of packet sizes or delays.
+class distribution
+{
+protected:
+  void eat(std::istream& in, const char c)
+  {
+    char sep; in >> sep;
+    if(sep != c) throw bad_parameters();
+  }
+
+  void check_eof(std::istream& in)
+  {
+    if(in.fail() || !in.eof()) throw bad_parameters();
+  }
+
+public:
+  class bad_parameters { };
+  typedef boost::shared_ptr<distribution> ptr;
+  virtual ~distribution() { }
+  virtual double next(fast_rng& g) = 0;
+  virtual double mean() = 0;
+
+  /// Fill an array with n samples.
+  virtual void fill(fast_rng& g, double *x, size_t n)
+  {
+    for(size_t i = 0; i < n; i ++) x[i] = next(g);
+  }
+
+  /// Parse a distribution description of the form kind:parameters, or a
+  /// single number for a Dirac distribution.
+  /// \throws std::runtime_error if the description is invalid
+  static ptr parse(const std::string& u);
+};
+
+class dirac : public distribution
+{
+  double x0;
+
+public:
+  typedef boost::shared_ptr<dirac> ptr;
+  dirac(std::istream& in)
+  {
+    in >> x0;
+    check_eof(in);
+  }
+  dirac(double x0_) : x0(x0_) { }
+  double next(fast_rng& g) { return x0; }
+  double mean() { return x0; }
+  void fill(fast_rng& g, double *x, size_t n);
+};
+
+class uniform : public distribution
+{
+  double x0, x1;
+
+public:
+  typedef boost::shared_ptr<uniform> ptr;
+  uniform(std::istream& in)
+  {
+    in >> x0;
+    eat(in, ',');
+    in >> x1;
+    check_eof(in);
+  }
+  uniform(double x0_, double x1_) : x0(x0_), x1(x1_) { }
+  double next(fast_rng& g) { return x0 + (x1 - x0) * g.uniform(); }
+  double mean() { return 0.5 * (x0 + x1); }
+  void fill(fast_rng& g, double *x, size_t n);
+};
+
+/// Exponential distribution of given mean; as a delay distribution, it gives
+/// Poisson arrivals.
+class exponential : public distribution
+{
+  double mu;
+
+public:
+  exponential(std::istream& in)
+  {
+    in >> mu;
+    check_eof(in);
+    if(mu <= 0) throw bad_parameters();
+  }
+  double next(fast_rng& g) { return -mu * log1p(-g.uniform()); }
+  double mean() { return mu; }
+  void fill(fast_rng& g, double *x, size_t n);
+};
+
+/// Pareto distribution of scale xm and shape alpha.
+class pareto : public distribution
+{
+  double xm, alpha;
+
+public:
+  pareto(std::istream& in)
+  {
+    in >> xm;
+    eat(in, ',');
+    in >> alpha;
+    check_eof(in);
+    if(xm <= 0 || alpha <= 0) throw bad_parameters();
+  }
+  double next(fast_rng& g) { return xm * pow(1 - g.uniform(), -1 / alpha); }
+  double mean() { return alpha > 1 ? alpha * xm / (alpha - 1) : HUGE_VAL; }
+};
+
+/// Log-normal distribution, whose logarithm has mean mu and standard deviation sigma.
+class lognormal : public distribution
+{
+  double mu, sigma;
+
+public:
+  lognormal(std::istream& in)
+  {
+    in >> mu;
+    eat(in, ',');
+    in >> sigma;
+    check_eof(in);
+    if(sigma < 0) throw bad_parameters();
+  }
+  double next(fast_rng& g) { return exp(mu + sigma * g.normal()); }
+  double mean() { return exp(mu + 0.5 * sigma * sigma); }
+};
+
+/// \brief Discrete distribution over a finite set of weighted values,
+/// sampled in constant time using Vose's alias method.
+class empirical : public distribution
+{
+  std::vector<double> values, prob;
+  std::vector<uint32_t> alias;
+  double mu;
+
+public:
+  /// \param values  Values
+  /// \param weights Non-negative weights, not all zero
+  empirical(const std::vector<double>& values, const std::vector<double>& weights);
+
+  /// Load a histogram from a file of "value weight" lines.
+  /// \throws std::runtime_error if the file cannot be read or is invalid
+  static ptr load(const std::string& file);
+
+  /// Return one of the IMIX presets "simple" or "tolly", as UDP payload sizes.
+  /// \throws bad_parameters if the name is unknown
+  static ptr imix(const std::string& name);
+
+  double next(fast_rng& g)
+  {
+    const uint64_t r = g.get();
+    const uint64_t i = (unsigned __int128) r * values.size() >> 64;
+    // The low bits are independent enough from the index for the coin
+    const double coin = (r & 0xffffffff) * (1.0 / 4294967296.0);
+    return coin < prob[i] ? values[i] : values[alias[i]];
+  }
+
+  double mean() { return mu; }
+};
+
+#endif
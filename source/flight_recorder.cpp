@@ -0,0 +1,124 @@
+// flight_recorder.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "flight_recorder.hpp"
+#include "probes.hpp"
+
+using namespace std;
+
+flight_recorder::flight_recorder(packet_log::ptr inner_, log_kind kind_, const string& path_,
+                                 const flight_recorder_settings& s_) :
+  inner(inner_),
+  kind(kind_),
+  path(path_),
+  s(s_),
+  ring(s_.before + s_.after),
+  head(0),
+  filled(0),
+  post_remaining(0),
+  reason(0),
+  have_delay(false),
+  delay_origin(0),
+  delay_min(0),
+  triggers(0), dumps(0), skipped(0),
+  pending(s_.before + s_.after),
+  pending_n(0),
+  pending_reason(0),
+  stopping(false)
+{
+  if(ring.empty()) throw runtime_error("The flight recorder needs room for at least one record");
+  writer = thread(&flight_recorder::run, this);
+}
+
+flight_recorder::~flight_recorder()
+{
+  // Dump what was recorded after a trigger before the end of the run
+  if(post_remaining > 0) dump();
+  {
+    unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+void flight_recorder::dump()
+{
+  post_remaining = 0;
+  unique_lock<std::mutex> lock(mutex);
+  if(pending_n > 0 || dumps >= max_dumps)
+  {
+    skipped ++;
+    PROBE2(log_overflow, "flight", skipped);
+    return;
+  }
+
+  // Oldest record first
+  const size_t start = filled < ring.size() ? 0 : head;
+  for(size_t i = 0; i < filled; i ++)
+  {
+    const size_t j = start + i;
+    pending[i] = ring[j < ring.size() ? j : j - ring.size()];
+  }
+  pending_n = filled;
+  pending_reason = reason;
+  pending_trigger = trigger_record;
+  dumps ++;
+  lock.unlock();
+  wake.notify_one();
+}
+
+void flight_recorder::run()
+{
+  nat k = 0;
+  unique_lock<std::mutex> lock(mutex);
+
+  for(;;)
+  {
+    wake.wait(lock, [this] { return stopping || pending_n > 0; });
+    if(pending_n == 0) break;
+
+    // The ring is only read by this thread until pending_n is cleared
+    lock.unlock();
+
+    stringstream name;
+    name << path << ".flight-" << ++ k;
+    ofstream out(name.str().c_str());
+    if(out)
+    {
+      const log_record& t = pending_trigger;
+      out << "# Flight recorder dump " << k << ": " << pending_reason;
+      if(t.status == missing_marker) out << " of " << t.errors << " packets, " << t.seq << " to " << t.t_tx << "\n";
+      else out << " at t " << t.t << ", seq " << t.seq << "\n";
+      out << log_codec::text_header(kind) << "\n";
+      for(size_t i = 0; i < pending_n; i ++)
+      {
+        const log_record& r = pending[i];
+        if(r.status == missing_marker)
+        {
+          const log_missing m = { 0, r.errors, uint32_t(r.seq), uint32_t(r.t_tx) };
+          log_codec::write_text(out, m);
+        }
+        else log_codec::write_text(out, kind, r);
+      }
+    }
+    if(!out) cerr << "Cannot write flight recorder dump " << name.str() << endl;
+
+    lock.lock();
+    pending_n = 0;
+  }
+}
+
+ostream& operator<<(ostream& out, const flight_recorder& self)
+{
+  out << "Flight recorder: " << self.triggers << " triggers, " << self.dumps << " dumps written to "
+      << self.path << ".flight-*";
+  if(self.skipped > 0) out << ", " << self.skipped << " skipped";
+  return out;
+}
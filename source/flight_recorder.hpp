@@ -0,0 +1,144 @@
+// flight_recorder.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef FLIGHT_RECORDER_HPP_20261019
+#define FLIGHT_RECORDER_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "packet_log.hpp"
+#include "rx_status.hpp"
+
+/// Flight recorder settings, from the --flight-* options.
+struct flight_recorder_settings
+{
+  nat before;          // Records kept before a trigger, 0 to disable the recorder
+  nat after;           // Records recorded after a trigger before dumping
+  nat loss_burst;      // Trigger on this many consecutive missing decodables, 0 to disable
+  int64_t delay_spike; // Trigger when a delay exceeds the lowest one by this many us, 0 to disable
+
+  flight_recorder_settings() : before(0), after(1000), loss_burst(10), delay_spike(10000) { }
+};
+
+/// \brief Keep the last records of a log in memory and dump them around
+/// anomalies.
+///
+/// Wraps a packet log, to which everything is passed on.  The records also go
+/// into a ring of before + after entries, which costs a copy per packet.  When
+/// a trigger fires (a run of missing sequence numbers, a payload error, a
+/// delay spike, or an explicit call to trigger()), recording goes on for
+/// after more records, then the ring is handed to a background thread that
+/// writes it to path.flight-K in the text log format, with the trigger in a
+/// comment.  Triggers are ignored while a dump is being collected, and dumps
+/// are skipped while the previous one is being written and after max_dumps.
+class flight_recorder : public packet_log
+{
+public:
+  enum { max_dumps = 100 };
+
+private:
+  packet_log::ptr inner;
+  const log_kind kind;
+  const std::string path;
+  const flight_recorder_settings s;
+
+  // Ring of records; missing ranges are stored as records whose status is missing_marker
+  enum { missing_marker = 0xffffffff };
+  std::vector<log_record> ring;
+  size_t head, filled;
+
+  nat post_remaining; // Records still to record before dumping, 0 if not triggered
+  const char *reason;
+  log_record trigger_record;
+
+  bool have_delay;
+  uint32_t delay_origin;
+  int32_t delay_min;
+
+  uint64_t triggers, dumps, skipped;
+
+  // Dump handed to the writer thread
+  std::vector<log_record> pending;
+  size_t pending_n;
+  const char *pending_reason;
+  log_record pending_trigger;
+  bool stopping;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread writer;
+
+  void push(const log_record& r)
+  {
+    ring[head] = r;
+    head = head + 1 == ring.size() ? 0 : head + 1;
+    if(filled < ring.size()) filled ++;
+    if(post_remaining > 0 && -- post_remaining == 0) dump();
+  }
+
+  void dump();
+  void run();
+
+public:
+  typedef boost::shared_ptr<flight_recorder> ptr;
+
+  /// \param path Name of the log, to which dump file suffixes are appended
+  flight_recorder(packet_log::ptr inner, log_kind kind, const std::string& path, const flight_recorder_settings& s);
+  ~flight_recorder();
+
+  void add(const log_record& r)
+  {
+    inner->add(r);
+    push(r);
+
+    if(kind == log_rx && post_remaining == 0)
+    {
+      if(r.status & (rx_ber | rx_crc)) trigger("payload error");
+      else if(s.delay_spike > 0 && !(r.status & (rx_damaged | rx_dup)))
+      {
+        // Headers carry the low 32 bits of the transmission time
+        const uint32_t raw = uint32_t(r.t) - uint32_t(r.t_tx);
+        if(!have_delay)
+        {
+          delay_origin = raw;
+          delay_min = 0;
+          have_delay = true;
+        }
+        const int32_t d = int32_t(raw - delay_origin);
+        if(d < delay_min) delay_min = d;
+        else if(d - delay_min > s.delay_spike) trigger("delay spike");
+      }
+    }
+  }
+
+  void missing(uint32_t count, uint32_t first, uint32_t last)
+  {
+    inner->missing(count, first, last);
+    const log_record r = { 0, 0, missing_marker, first, last, count };
+    push(r);
+    if(s.loss_burst > 0 && count >= s.loss_burst) trigger("loss burst");
+  }
+
+  /// Fire a trigger caused by the last record.
+  void trigger(const char *reason_)
+  {
+    if(post_remaining > 0) return;
+    triggers ++;
+    reason = reason_;
+    trigger_record = ring[head == 0 ? ring.size() - 1 : head - 1];
+    post_remaining = s.after;
+    if(post_remaining == 0) dump();
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const flight_recorder& self);
+};
+
+#endif
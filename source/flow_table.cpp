@@ -0,0 +1,117 @@
+// flow_table.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <arpa/inet.h>
+
+#include "flow_table.hpp"
+#include "port_list.hpp"
+
+using namespace std;
+
+enum
+{
+  max_sockets = 1024,
+  max_payload = 65507
+};
+
+static uint32_t parse_address(const string& u)
+{
+  struct in_addr a;
+  if(inet_pton(AF_INET, u.c_str(), &a) != 1) throw runtime_error("Bad IPv4 address " + u);
+  return ntohl(a.s_addr);
+}
+
+void flow_table::add(uint32_t address_, uint16_t port_, double rate, size_t size_, uint16_t source_port)
+{
+  if(!(rate > 0)) throw runtime_error("Flow rates must be positive");
+  if(size_ > max_payload) throw runtime_error("Flow packet size too large");
+
+  map<uint16_t, uint16_t>::iterator it = socket_of_port.find(source_port);
+  if(it == socket_of_port.end())
+  {
+    if(source_ports.size() >= max_sockets) throw runtime_error("Too many distinct flow source ports");
+    it = socket_of_port.insert(make_pair(source_port, uint16_t(source_ports.size()))).first;
+    source_ports.push_back(source_port);
+  }
+
+  address.push_back(htonl(address_));
+  port.push_back(port_);
+  socket.push_back(it->second);
+  size.push_back(size_);
+  gap.push_back(int64_t(1e9 / rate));
+  next_t.push_back(0);
+  seq.push_back(0);
+}
+
+void flow_table::load(const string& path)
+{
+  ifstream in(path.c_str());
+  if(!in.good()) throw runtime_error("Cannot open flow file " + path);
+
+  string line;
+  nat line_number = 0;
+  while(getline(in, line))
+  {
+    line_number ++;
+    const size_t hash = line.find('#');
+    if(hash != string::npos) line.erase(hash);
+
+    stringstream fields(line);
+    string a, p, s;
+    double rate;
+    size_t sz;
+    if(!(fields >> a)) continue;
+
+    try
+    {
+      if(!(fields >> p >> rate >> sz)) throw runtime_error("Expected: address port rate size [source_port]");
+      uint32_t source_port = 0;
+      if(fields >> s) source_port = parse_port(s);
+      add(parse_address(a), parse_port(p), rate, sz, source_port);
+    }
+    catch(runtime_error& e)
+    {
+      stringstream u;
+      u << path << ":" << line_number << ": " << e.what();
+      throw runtime_error(u.str());
+    }
+  }
+}
+
+void flow_table::add_range(const string& spec, double rate, size_t size_)
+{
+  const size_t colon = spec.find(':');
+  const string addresses = spec.substr(0, colon),
+               ports = colon == string::npos ? "" : spec.substr(colon + 1);
+  if(addresses.empty() || ports.empty()) throw runtime_error("Bad flow range " + spec + ", expected A[-A]:P[-P]");
+
+  const size_t da = addresses.find('-'), dp = ports.find('-');
+  const uint32_t a0 = parse_address(addresses.substr(0, da)),
+                 a1 = da == string::npos ? a0 : parse_address(addresses.substr(da + 1)),
+                 p0 = parse_port(ports.substr(0, dp)),
+                 p1 = dp == string::npos ? p0 : parse_port(ports.substr(dp + 1));
+  if(a1 < a0 || p1 < p0) throw runtime_error("Empty flow range " + spec);
+
+  for(uint64_t a = a0; a <= a1; a ++)
+  {
+    for(uint32_t p = p0; p <= p1; p ++) add(a, p, rate, size_, 0);
+  }
+}
+
+ostream& operator<<(ostream& out, const flow_table& self)
+{
+  double rate = 0, bandwidth = 0;
+  for(size_t f = 0; f < self.flows(); f ++)
+  {
+    rate += 1e9 / self.gap[f];
+    bandwidth += 8e3 * self.size[f] / self.gap[f];
+  }
+  out << "Flows: " << self.flows() << " flows over " << self.source_ports.size() << " sockets, "
+      << rate << " pk/s, " << bandwidth << " Mbit/s";
+  return out;
+}
@@ -0,0 +1,51 @@
+// flow_table.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef FLOW_TABLE_HPP_20261019
+#define FLOW_TABLE_HPP_20261019
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include "shorthands.hpp"
+
+/// \brief Flows of the multi-flow transmitter, as a structure of arrays.
+/// Each flow has its own destination, rate, packet size and sequence number
+/// space.  Flows sharing a source port share a socket.
+struct flow_table
+{
+  std::vector<uint32_t> address;  // Destination IPv4 address, network byte order
+  std::vector<uint16_t> port;     // Destination port
+  std::vector<uint16_t> socket;   // Index of the sending socket in source_ports
+  std::vector<uint16_t> size;     // UDP payload size in bytes
+  std::vector<int64_t> gap;       // Time between packets in nanoseconds
+  std::vector<int64_t> next_t;    // Send time of the next packet in nanoseconds
+  std::vector<uint32_t> seq;      // Sequence number of the next packet
+
+  std::vector<uint16_t> source_ports; // Source port of each socket, 0 for any
+
+  size_t flows() const { return address.size(); }
+
+  /// Add a flow.
+  /// \param rate Packets per second
+  void add(uint32_t address, uint16_t port, double rate, size_t size, uint16_t source_port);
+
+  /// Add the flows listed in a file, one "address port rate size [source_port]"
+  /// line per flow, rates in packets per second.
+  void load(const std::string& path);
+
+  /// Add one flow per destination address and port of a range such as
+  /// 10.0.0.1-10.0.0.8:5000-5099, the address and port ranges being optional.
+  void add_range(const std::string& spec, double rate, size_t size);
+
+  friend std::ostream& operator<<(std::ostream& out, const flow_table& self);
+
+private:
+  std::map<uint16_t, uint16_t> socket_of_port;
+};
+
+#endif
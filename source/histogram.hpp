@@ -0,0 +1,107 @@
+// histogram.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef HISTOGRAM_HPP_20261019
+#define HISTOGRAM_HPP_20261019
+
+#include <iostream>
+#include <algorithm>
+
+#include "shorthands.hpp"
+
+/// \brief Histogram of non-negative integers with logarithmic buckets.
+/// Each power of two is split into eight linear sub-buckets, so that
+/// quantiles are accurate to about 12%.  Adding a value is O(1) and never
+/// allocates.
+class histogram
+{
+public:
+  enum { sub_bits = 3, sub = 1 << sub_bits, buckets = (64 - sub_bits + 1) * sub };
+
+private:
+  uint64_t counts[buckets];
+  uint64_t n, min_, max_;
+  double total;
+
+  static nat index(uint64_t x)
+  {
+    if(x < sub) return x;
+    const nat msb = 63 - __builtin_clzll(x);
+    return (msb - sub_bits + 1) * sub + ((x >> (msb - sub_bits)) & (sub - 1));
+  }
+
+  /// Return the largest value falling in bucket i.
+  static uint64_t upper(nat i)
+  {
+    if(i < sub) return i;
+    const nat msb = i / sub + sub_bits - 1;
+    return ((uint64_t(sub + i % sub) + 1) << (msb - sub_bits)) - 1;
+  }
+
+public:
+  histogram() { clear(); }
+
+  void clear()
+  {
+    std::fill(counts, counts + buckets, 0);
+    n = 0;
+    min_ = 0;
+    max_ = 0;
+    total = 0;
+  }
+
+  void add(uint64_t x)
+  {
+    counts[index(x)] ++;
+    if(!n || x < min_) min_ = x;
+    if(!n || x > max_) max_ = x;
+    n ++;
+    total += x;
+  }
+
+  /// Add the counts of another histogram.
+  void merge(const histogram& h)
+  {
+    for(nat i = 0; i < buckets; i ++) counts[i] += h.counts[i];
+    if(h.n && (!n || h.min_ < min_)) min_ = h.min_;
+    if(h.n && (!n || h.max_ > max_)) max_ = h.max_;
+    n += h.n;
+    total += h.total;
+  }
+
+  uint64_t count() const { return n; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return n ? total / n : 0; }
+
+  /// Return an upper bound of the q-quantile, 0 <= q <= 1.
+  uint64_t quantile(double q) const
+  {
+    if(!n) return 0;
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(q * n + 0.5));
+    uint64_t c = 0;
+    for(nat i = 0; i < buckets; i ++)
+    {
+      c += counts[i];
+      if(c >= rank) return std::min(upper(i), max_);
+    }
+    return max_;
+  }
+
+  /// Display a one-line summary, dividing values by the given scale.
+  void summary(std::ostream& out, double scale=1, const char *unit="") const
+  {
+    out <<
+      "min "      << min_ / scale           << unit <<
+      ", mean "   << mean() / scale         << unit <<
+      ", p50 "    << quantile(0.5) / scale  << unit <<
+      ", p90 "    << quantile(0.9) / scale  << unit <<
+      ", p99 "    << quantile(0.99) / scale << unit <<
+      ", p99.9 "  << quantile(0.999) / scale << unit <<
+      ", max "    << max_ / scale           << unit;
+  }
+};
+
+#endif
@@ -0,0 +1,139 @@
+// impairment.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <sstream>
+#include <stdexcept>
+
+#include "impairment.hpp"
+
+using namespace std;
+
+namespace
+{
+  bool is_probability(double p) { return p >= 0 && p <= 1; }
+
+  /// Read a comma-separated list of at least min_n and at most max_n numbers.
+  vector<string> split(const string& u, const string& what, size_t min_n, size_t max_n)
+  {
+    vector<string> fields;
+    stringstream in(u);
+    string field;
+    while(getline(in, field, ',')) fields.push_back(field);
+    if(fields.size() < min_n || fields.size() > max_n) throw runtime_error("Bad " + what + " description " + u);
+    return fields;
+  }
+
+  double number(const string& u, const string& what)
+  {
+    stringstream in(u);
+    double x;
+    in >> x;
+    if(in.fail() || !in.eof()) throw runtime_error("Bad " + what + " parameter " + u);
+    return x;
+  }
+
+  double probability(const string& u, const string& what)
+  {
+    const double p = number(u, what);
+    if(!is_probability(p)) throw runtime_error("Bad " + what + " probability " + u);
+    return p;
+  }
+}
+
+gilbert_elliott gilbert_elliott::parse(const string& u)
+{
+  const vector<string> f = split(u, "burst loss", 2, 4);
+  gilbert_elliott ge;
+  ge.p = probability(f[0], "burst loss");
+  ge.r = probability(f[1], "burst loss");
+  if(f.size() > 2) ge.loss_bad = probability(f[2], "burst loss");
+  if(f.size() > 3) ge.loss_good = probability(f[3], "burst loss");
+  if(ge.p > 0 && ge.r == 0) throw runtime_error("The bad state of a burst loss model must end");
+  return ge;
+}
+
+reorder_model reorder_model::parse(const string& u)
+{
+  const vector<string> f = split(u, "reordering", 2, 2);
+  reorder_model r;
+  r.p = probability(f[0], "reordering");
+  const string& d = f[1];
+  if(d.size() > 2 && d.compare(d.size() - 2, 2, "us") == 0)
+  {
+    const double t = number(d.substr(0, d.size() - 2), "reordering");
+    if(!(t > 0)) throw runtime_error("Reordering delays must be positive");
+    r.delay = int64_t(1e3 * t);
+  }
+  else
+  {
+    const double n = number(d, "reordering");
+    if(n < 1 || n != nat(n)) throw runtime_error("Reordering distances must be positive integers");
+    r.positions = n;
+  }
+  return r;
+}
+
+corruption_model corruption_model::parse(const string& u)
+{
+  const vector<string> f = split(u, "corruption", 1, 2);
+  corruption_model c;
+  c.p = probability(f[0], "corruption");
+  if(f.size() > 1)
+  {
+    const double b = number(f[1], "corruption");
+    if(b < 1 || b > max_bits || b != nat(b)) throw runtime_error("Corrupted bits per packet must be between 1 and 64");
+    c.bits = b;
+  }
+  return c;
+}
+
+ostream& operator<<(ostream& out, const impairment_settings& self)
+{
+  out << "Impairments:";
+  const gilbert_elliott& ge = self.loss;
+  if(ge.p > 0)
+  {
+    out << "\n  Gilbert-Elliott loss: p " << ge.p << ", r " << ge.r << ", loss " << ge.loss_good << " in the good state, "
+        << ge.loss_bad << " in the bad state (mean burst " << 1 / ge.r << " pk, expected loss ratio "
+        << (ge.r * ge.loss_good + ge.p * ge.loss_bad) / (ge.p + ge.r) << ")";
+  }
+  else if(ge.loss_good > 0) out << "\n  Independent loss: " << ge.loss_good;
+  if(self.reorder.p > 0)
+  {
+    out << "\n  Reordering: " << self.reorder.p << ", held back by ";
+    if(self.reorder.delay > 0) out << 1e-3 * self.reorder.delay << " us";
+    else out << self.reorder.positions << " pk";
+  }
+  if(self.p_duplicate > 0) out << "\n  Duplication: " << self.p_duplicate;
+  if(self.corrupt.p > 0) out << "\n  Corruption: " << self.corrupt.p << ", " << self.corrupt.bits << " bit(s) per packet";
+  return out;
+}
+
+impairment::impairment(const impairment_settings& s_, const fast_rng& g_, size_t max_size, const string& log_file) :
+  s(s_),
+  g(g_),
+  bad(false),
+  position(0),
+  held(s_.reorder.p > 0 ? max_held : 0, vector<char>(max_size)),
+  head(0), n_held(0), released_in_batch(0),
+  lost(0), lost_bad(0), corrupted(0), flipped(0), duplicated(0), reordered(0), not_held(0)
+{
+  if(!log_file.empty())
+  {
+    log.open(log_file.c_str());
+    if(!log) throw runtime_error("Cannot open impairment log " + log_file);
+    log << "# t seq event n\n";
+  }
+}
+
+ostream& operator<<(ostream& out, const impairment& self)
+{
+  out << "Injected: " << self.lost << " lost";
+  if(self.s.loss.p > 0) out << " (" << self.lost_bad << " in the bad state)";
+  out << ", " << self.duplicated << " duplicated, " << self.reordered << " reordered, "
+      << self.corrupted << " corrupted (" << self.flipped << " bits)";
+  if(self.not_held > 0) out << ", " << self.not_held << " not reordered for lack of buffers";
+  return out;
+}
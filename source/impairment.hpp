@@ -0,0 +1,258 @@
+// impairment.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef IMPAIRMENT_HPP_20261019
+#define IMPAIRMENT_HPP_20261019
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "rng.hpp"
+#include "rtclock.hpp"
+#include "packet_header.hpp"
+
+/// Gilbert-Elliott loss model, from --burst-loss P,R[,LB[,LG]] or --p-loss.
+/// After each packet, the channel goes from the good to the bad state with
+/// probability p and back with probability r; packets are lost with
+/// probability loss_good in the good state and loss_bad in the bad state.
+struct gilbert_elliott
+{
+  double p, r, loss_bad, loss_good;
+
+  /// Independent losses with probability loss.
+  explicit gilbert_elliott(double loss=0) : p(0), r(1), loss_bad(1), loss_good(loss) { }
+
+  bool active() const { return loss_good > 0 || (p > 0 && loss_bad > 0); }
+
+  /// \throws std::runtime_error if the description is invalid
+  static gilbert_elliott parse(const std::string& u);
+};
+
+/// Reordering, from --reorder P,N or --reorder P,Tus: each packet is held back
+/// with probability p until n later packets have been sent, or for t
+/// microseconds.
+struct reorder_model
+{
+  double p;
+  nat positions;
+  int64_t delay; // In ns; positions are used when 0
+
+  reorder_model() : p(0), positions(1), delay(0) { }
+
+  /// \throws std::runtime_error if the description is invalid
+  static reorder_model parse(const std::string& u);
+};
+
+/// Payload corruption, from --corrupt P[,B]: the payload of each packet gets
+/// b distinct bits flipped with probability p.
+struct corruption_model
+{
+  enum { max_bits = 64 };
+
+  double p;
+  nat bits;
+
+  corruption_model() : p(0), bits(1) { }
+
+  /// \throws std::runtime_error if the description is invalid
+  static corruption_model parse(const std::string& u);
+};
+
+struct impairment_settings
+{
+  gilbert_elliott loss;
+  reorder_model reorder;
+  double p_duplicate;
+  corruption_model corrupt;
+
+  impairment_settings() : p_duplicate(0) { }
+
+  bool active() const { return loss.active() || reorder.p > 0 || p_duplicate > 0 || corrupt.p > 0; }
+
+  friend std::ostream& operator<<(std::ostream& out, const impairment_settings& self);
+};
+
+/// \brief Transmitter-side impairment stage.
+///
+/// Packets built by the transmitter go through apply(), which passes those
+/// that survive to an emit(char *buffer, size_t size) function, possibly
+/// twice, possibly later.  Held packets are copied into a fixed set of
+/// buffers.  Emitted buffers must stay valid until the end of the current
+/// batch, so a buffer released during a batch is only reused in the next one.
+/// Every injected impairment is counted and, if a log file is given, written
+/// to it as "t seq event n", with t from the same clock as the transmission
+/// log.  Packets too short to hold a header are never impaired.
+class impairment
+{
+public:
+  enum { max_held = 64 }; // Held packets; no more are held while these are in use
+
+private:
+  const impairment_settings s;
+  fast_rng g;
+  bool bad;
+  uint64_t position; // Packets emitted so far, duplicates and held packets excepted
+
+  std::vector< std::vector<char> > held;
+  size_t held_size[max_held];
+  uint32_t held_seq[max_held];
+  uint64_t held_position[max_held];
+  int64_t held_release[max_held]; // Position or time, depending on the reorder model
+  nat head, n_held, released_in_batch;
+
+  std::ofstream log;
+  rtclock clk;
+
+  uint64_t lost, lost_bad, corrupted, flipped, duplicated, reordered, not_held;
+
+  void record(uint32_t seq, const char *event, uint64_t n)
+  {
+    if(log.is_open()) log << clk.get() << " " << seq << " " << event << " " << n << "\n";
+  }
+
+  static uint32_t sequence(const char *buffer) { return packet_header(buffer).sequence; }
+
+  void flip_bits(char *payload, size_t m)
+  {
+    const uint64_t n = 8 * uint64_t(m);
+    const nat b = std::min<uint64_t>(s.corrupt.bits, n);
+    uint64_t chosen[corruption_model::max_bits];
+
+    for(nat i = 0; i < b; i ++)
+    {
+      uint64_t k;
+      bool again;
+      do
+      {
+        k = g.below(n);
+        again = false;
+        for(nat j = 0; j < i; j ++) again |= chosen[j] == k;
+      }
+      while(again);
+      chosen[i] = k;
+      payload[k >> 3] ^= 1 << (k & 7);
+    }
+    corrupted ++;
+    flipped += b;
+  }
+
+  template<class Emit>
+  void release_one(Emit& emit)
+  {
+    const nat i = head;
+    emit(held[i].data(), held_size[i]);
+    record(held_seq[i], "reorder", position - held_position[i]);
+    reordered ++;
+    head = (head + 1) % max_held;
+    n_held --;
+    released_in_batch ++;
+  }
+
+public:
+  typedef boost::shared_ptr<impairment> ptr;
+
+  /// \param max_size Largest packet, for sizing the held packet buffers
+  /// \param log_file File to log impairments to, or empty
+  impairment(const impairment_settings& s_, const fast_rng& g_, size_t max_size, const std::string& log_file);
+
+  /// Start a batch of packets sent together.
+  void begin_batch() { released_in_batch = 0; }
+
+  /// Process a packet built at time t, in ns on the caller's clock.
+  template<class Emit>
+  void apply(char *buffer, size_t size, int64_t t, Emit emit)
+  {
+    if(size < packet_header::encoded_size)
+    {
+      emit(buffer, size);
+      return;
+    }
+
+    if(s.loss.active())
+    {
+      const double p_loss = bad ? s.loss.loss_bad : s.loss.loss_good;
+      const bool lose = p_loss > 0 && g.uniform() < p_loss, was_bad = bad;
+      if(bad) bad = g.uniform() >= s.loss.r;
+      else if(s.loss.p > 0) bad = g.uniform() < s.loss.p;
+      if(lose)
+      {
+        lost ++;
+        lost_bad += was_bad;
+        record(sequence(buffer), "loss", was_bad);
+        return;
+      }
+    }
+
+    if(s.corrupt.p > 0 && size > packet_header::encoded_size && g.uniform() < s.corrupt.p)
+    {
+      flip_bits(buffer + packet_header::encoded_size, size - packet_header::encoded_size);
+      record(sequence(buffer), "corrupt", std::min<uint64_t>(s.corrupt.bits, 8 * (size - packet_header::encoded_size)));
+    }
+
+    if(s.reorder.p > 0 && g.uniform() < s.reorder.p)
+    {
+      if(n_held + released_in_batch < max_held)
+      {
+        const nat i = (head + n_held) % max_held;
+        memcpy(held[i].data(), buffer, size);
+        held_size[i] = size;
+        held_seq[i] = sequence(buffer);
+        held_position[i] = position;
+        held_release[i] = s.reorder.delay > 0 ? t + s.reorder.delay : int64_t(position + s.reorder.positions);
+        n_held ++;
+        return;
+      }
+      not_held ++;
+    }
+
+    emit(buffer, size);
+    position ++;
+
+    if(s.p_duplicate > 0 && g.uniform() < s.p_duplicate)
+    {
+      emit(buffer, size);
+      duplicated ++;
+      record(sequence(buffer), "dup", 1);
+    }
+
+    if(s.reorder.delay == 0)
+    {
+      while(n_held > 0 && held_release[head] <= int64_t(position)) release_one(emit);
+    }
+  }
+
+  /// Emit the packets held back by a time that has elapsed at time t.
+  template<class Emit>
+  void release(int64_t t, Emit emit)
+  {
+    if(s.reorder.delay == 0) return;
+    while(n_held > 0 && held_release[head] <= t) release_one(emit);
+  }
+
+  /// Emit all held packets.
+  template<class Emit>
+  void flush(Emit emit)
+  {
+    while(n_held > 0) release_one(emit);
+  }
+
+  /// Time at which the next held packet is due, or the largest time if none is
+  /// held back by time.
+  int64_t next_release() const
+  {
+    if(s.reorder.delay == 0 || n_held == 0) return std::numeric_limits<int64_t>::max();
+    return held_release[head];
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const impairment& self);
+};
+
+#endif
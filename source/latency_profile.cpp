@@ -0,0 +1,153 @@
+// latency_profile.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "latency_profile.hpp"
+
+using namespace std;
+
+#ifndef SO_BUSY_POLL
+  #define SO_BUSY_POLL 46
+#endif
+
+#ifndef SO_PREFER_BUSY_POLL
+  #define SO_PREFER_BUSY_POLL 69
+#endif
+
+enum
+{
+  stack_prefault_size = 256 * 1024
+};
+
+latency_profile::latency_profile(int cpu_, int rt_priority_, nat busy_poll_) :
+  cpu(cpu_),
+  rt_priority(rt_priority_),
+  busy_poll(busy_poll_)
+{
+}
+
+// Settings applied to each of many sockets are reported once
+static void add_once(vector<string>& notes, const string& note)
+{
+  if(find(notes.begin(), notes.end(), note) == notes.end()) notes.push_back(note);
+}
+
+void latency_profile::fail(const string& what)
+{
+  add_once(failed, what + " (" + strerror(errno) + ")");
+}
+
+void latency_profile::setup_process()
+{
+  if(mlockall(MCL_CURRENT | MCL_FUTURE)) fail("mlockall");
+  else applied.push_back("memory locked");
+
+  volatile char stack[stack_prefault_size];
+  const long page = sysconf(_SC_PAGESIZE);
+  for(size_t i = 0; i < sizeof(stack); i += page) stack[i] = 0;
+}
+
+void latency_profile::setup_thread()
+{
+  cpu_set_t set;
+  if(cpu >= 0)
+  {
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(sched_setaffinity(0, sizeof(set), &set))
+    {
+      stringstream u;
+      u << "pinning to CPU " << cpu;
+      fail(u.str());
+    }
+  }
+
+  if(sched_getaffinity(0, sizeof(set), &set) == 0)
+  {
+    stringstream placement;
+    placement << "CPUs ";
+    bool first = true;
+    for(int c = 0; c < CPU_SETSIZE; c ++)
+    {
+      if(!CPU_ISSET(c, &set)) continue;
+      int d = c;
+      while(d + 1 < CPU_SETSIZE && CPU_ISSET(d + 1, &set)) d ++;
+      if(!first) placement << ",";
+      placement << c;
+      if(d > c) placement << "-" << d;
+      first = false;
+      c = d;
+    }
+    placement << ", running on CPU " << sched_getcpu();
+    applied.push_back(placement.str());
+  }
+
+  if(rt_priority > 0)
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = rt_priority;
+    stringstream u;
+    u << "SCHED_FIFO priority " << rt_priority;
+    if(sched_setscheduler(0, SCHED_FIFO, &param)) fail(u.str());
+    else applied.push_back(u.str());
+  }
+}
+
+void latency_profile::release_helper_thread(int cpu)
+{
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  sched_setscheduler(0, SCHED_OTHER, &param);
+
+  if(cpu < 0) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for(int c = 0; c < cpus && c < CPU_SETSIZE; c ++) if(c != cpu) CPU_SET(c, &set);
+  if(CPU_COUNT(&set) > 0) sched_setaffinity(0, sizeof(set), &set);
+}
+
+void latency_profile::setup_socket(int fd)
+{
+  if(busy_poll == 0) return;
+
+  int value = busy_poll;
+  stringstream u;
+  u << "busy polling " << busy_poll << " us";
+  if(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value))) fail(u.str());
+  else add_once(applied, u.str());
+
+  value = 1;
+  if(setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value))) fail("preferred busy polling");
+  else add_once(applied, "preferred busy polling");
+}
+
+void latency_profile::prefault(void *buffer, size_t size)
+{
+  volatile char *p = static_cast<char *>(buffer);
+  const long page = sysconf(_SC_PAGESIZE);
+  for(size_t i = 0; i < size; i += page) p[i] = p[i];
+}
+
+ostream& operator<<(ostream& out, const latency_profile& self)
+{
+  out << "Low-latency profile: ";
+  for(size_t i = 0; i < self.applied.size(); i ++) out << (i ? ", " : "") << self.applied[i];
+  if(!self.failed.empty())
+  {
+    out << "\n  Could not apply: ";
+    for(size_t i = 0; i < self.failed.size(); i ++) out << (i ? ", " : "") << self.failed[i];
+  }
+  return out;
+}
@@ -0,0 +1,53 @@
+// latency_profile.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef LATENCY_PROFILE_HPP_20261019
+#define LATENCY_PROFILE_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shorthands.hpp"
+
+/// \brief Runtime settings of the --low-latency profile.
+/// Each setting is applied on a best-effort basis: settings that cannot be
+/// applied, usually for lack of privileges, are recorded and reported in the
+/// startup banner instead of aborting.
+class latency_profile
+{
+  int cpu, rt_priority;
+  nat busy_poll;
+  std::vector<std::string> applied, failed;
+
+  void fail(const std::string& what);
+
+public:
+  /// \param cpu_ CPU to pin the sending or receiving thread to, or -1
+  /// \param rt_priority_ SCHED_FIFO priority of that thread, or 0 to keep the default policy
+  /// \param busy_poll_ Socket busy polling time in microseconds, or 0
+  latency_profile(int cpu_, int rt_priority_, nat busy_poll_);
+
+  /// Lock all current and future pages in memory and pre-fault the stack.
+  void setup_process();
+
+  /// Pin the calling thread and set its scheduling policy.  Threads created
+  /// afterwards inherit both, so helper threads should be started before.
+  void setup_thread();
+
+  /// Move a helper thread started after setup_thread() off the pinned CPU,
+  /// when there are others, and back to the default policy.  Best effort.
+  static void release_helper_thread(int cpu);
+
+  /// Enable busy polling on a socket, reporting it once for all sockets.
+  void setup_socket(int fd);
+
+  /// Touch every page of a buffer so that no page fault happens later.
+  static void prefault(void *buffer, size_t size);
+
+  friend std::ostream& operator<<(std::ostream& out, const latency_profile& self);
+};
+
+#endif
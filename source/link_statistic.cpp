@@ -3,6 +3,8 @@
 // Author: Berke Durak <berke.durak@gmail.com>
 // vim:set ts=2 sw=2 foldmarker={,}:
 
+#include <algorithm>
+
 #include "link_statistic.hpp"
 
 using namespace std;
@@ -13,7 +15,8 @@ link_statistic::link_statistic(nat running_average_window_, nat maximum_window_)
   start(microsecond_timer::get()),
   items(running_average_window_),
   buffer_total(0),
-  max_circular(maximum_window_)
+  max_window(std::max<nat>(maximum_window_, 1)),
+  max_candidates(max_window)
 {
 }
 
@@ -31,20 +34,14 @@ void link_statistic::add(size_t size, microsecond_timer::microseconds t)
   buffer_total += size;
 
   double bw = average_bandwidth();
-  if(max_circular.full())
-  {
-    max_set.erase(max_circular.back());
-  }
-  max_circular.push_front(bw);
-  max_set.insert(bw);
+  while(!max_candidates.empty() && max_candidates.front().index + max_window <= count) max_candidates.pop_front();
+  while(!max_candidates.empty() && max_candidates.back().bw <= bw) max_candidates.pop_back();
+  max_candidates.push_back(max_item(bw, count));
 }
 
 double link_statistic::max_bandwidth() const
 {
-  multiset<double>::iterator it = max_set.end();
-  if(it == max_set.begin()) return 0;
-  -- it;
-  return *it;
+  return max_candidates.empty() ? 0 : max_candidates.front().bw;
 }
 
 double link_statistic::average_bandwidth() const
@@ -93,7 +90,7 @@ ostream& operator<<(ostream& out, const link_statistic& self)
       t_total              << " s; " <<
       "bw " <<
         kiB_to_MBit*self.average_bandwidth()       << " Mbit/s average (over " << t_average << " s at " << self.items.size()/t_average    << " packet/s), " <<
-        kiB_to_MBit*self.max_bandwidth()           << " Mbit/s max (over " << self.max_circular.size() << " samples), ";
+        kiB_to_MBit*self.max_bandwidth()           << " Mbit/s max (over " << std::min(self.count, self.max_window) << " samples), ";
   }
   return out;
 }
@@ -8,7 +8,6 @@
 
 #include <iostream>
 
-#include <set>
 #include <boost/circular_buffer.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -33,8 +32,17 @@ class link_statistic
   boost::circular_buffer<item> items; // For running average bandwidth computation
   size_t buffer_total;
 
-  boost::circular_buffer<double> max_circular;
-  std::multiset<double> max_set;
+  // Running maximum over the last max_window samples: the bandwidths of the
+  // samples not dominated by a later one, in decreasing order
+  struct max_item
+  {
+    double bw;
+    uint64_t index;
+
+    max_item(double bw_, uint64_t index_) : bw(bw_), index(index_) { }
+  };
+  nat max_window;
+  boost::circular_buffer<max_item> max_candidates;
 
 public:
   typedef boost::shared_ptr<link_statistic> ptr;
@@ -49,6 +57,12 @@ public:
   /// \param t    The time at which the packet has been transmitted (defaults to now)
   void add(size_t size, microsecond_timer::microseconds t=microsecond_timer::get());
 
+  /// Return the number of packets.
+  nat get_count() const { return count; }
+
+  /// Return the total size of the packets, in bytes.
+  size_t get_total() const { return total; }
+
   /// Return the average bandwidth.
   /// \returns Average bandwidth over the specificed number of samples, in kB/s
   double average_bandwidth() const;
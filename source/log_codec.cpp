@@ -0,0 +1,307 @@
+// log_codec.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "log_codec.hpp"
+#include "rx_status.hpp"
+
+using namespace std;
+
+namespace
+{
+  inline uint64_t zigzag(int64_t x) { return (uint64_t(x) << 1) ^ uint64_t(x >> 63); }
+  inline int64_t unzigzag(uint64_t x) { return int64_t(x >> 1) ^ -int64_t(x & 1); }
+
+  inline void put_varint(vector<char>& out, uint64_t x)
+  {
+    while(x >= 0x80)
+    {
+      out.push_back(char(x | 0x80));
+      x >>= 7;
+    }
+    out.push_back(char(x));
+  }
+
+  class corrupt { };
+
+  struct varint_reader
+  {
+    const unsigned char *p, *end;
+
+    varint_reader(const char *p_, size_t n) :
+      p(reinterpret_cast<const unsigned char *>(p_)),
+      end(reinterpret_cast<const unsigned char *>(p_) + n)
+    {
+    }
+
+    uint64_t get()
+    {
+      uint64_t x = 0;
+      for(nat shift = 0; shift < 64; shift += 7)
+      {
+        if(p == end) throw corrupt();
+        const unsigned char c = *(p ++);
+        x |= uint64_t(c & 0x7f) << shift;
+        if(!(c & 0x80)) return x;
+      }
+      throw corrupt();
+    }
+  };
+
+  // Run-length encoding of a column of unsigned values
+  template<typename F>
+  void put_runs(vector<char>& out, size_t n, F get)
+  {
+    size_t i = 0;
+    while(i < n)
+    {
+      const uint64_t x = get(i);
+      size_t j = i + 1;
+      while(j < n && get(j) == x) j ++;
+      put_varint(out, x);
+      put_varint(out, j - i);
+      i = j;
+    }
+  }
+
+  template<typename F>
+  void get_runs(varint_reader& in, size_t n, F set)
+  {
+    size_t i = 0;
+    while(i < n)
+    {
+      const uint64_t x = in.get(), run = in.get();
+      if(run == 0 || run > n - i) throw corrupt();
+      for(size_t j = 0; j < run; j ++) set(i ++, x);
+    }
+  }
+};
+
+namespace log_codec
+{
+  void encode_block(log_kind kind, const log_record *r, size_t n,
+                    const log_missing *missing, size_t n_missing, vector<char>& out)
+  {
+    const size_t start = out.size();
+    block_header h;
+    h.magic = block_magic;
+    h.records = n;
+    h.missing = n_missing;
+    h.bytes = 0;
+    h.t0 = n ? r[0].t : 0;
+    h.seq0 = n ? r[0].seq : 0;
+    out.resize(start + sizeof(h));
+
+    int64_t t = h.t0;
+    for(size_t i = 0; i < n; i ++)
+    {
+      put_varint(out, zigzag(r[i].t - t));
+      t = r[i].t;
+    }
+
+    put_runs(out, n, [&](size_t i) { return zigzag(r[i].seq - (i ? r[i - 1].seq : h.seq0 - 1) - 1); });
+    put_runs(out, n, [&](size_t i) { return uint64_t(r[i].size); });
+
+    if(kind == log_rx)
+    {
+      put_runs(out, n, [&](size_t i) { return uint64_t(r[i].status); });
+      put_runs(out, n, [&](size_t i) { return uint64_t(r[i].errors); });
+      int64_t offset = 0;
+      for(size_t i = 0; i < n; i ++)
+      {
+        const int64_t o = int64_t(r[i].t_tx) - r[i].t;
+        put_varint(out, zigzag(o - offset));
+        offset = o;
+      }
+    }
+
+    uint32_t index = 0;
+    for(size_t i = 0; i < n_missing; i ++)
+    {
+      put_varint(out, missing[i].index - index);
+      put_varint(out, missing[i].count);
+      put_varint(out, missing[i].first);
+      put_varint(out, missing[i].last);
+      index = missing[i].index;
+    }
+
+    h.bytes = out.size() - start - sizeof(h);
+    memcpy(out.data() + start, &h, sizeof(h));
+  }
+
+  void decode_block(log_kind kind, const block_header& h, const char *p,
+                    vector<log_record>& r, vector<log_missing>& missing)
+  {
+    const size_t n = h.records;
+    r.resize(n);
+    missing.resize(h.missing);
+
+    try
+    {
+      varint_reader in(p, h.bytes);
+
+      int64_t t = h.t0;
+      for(size_t i = 0; i < n; i ++)
+      {
+        t += unzigzag(in.get());
+        r[i].t = t;
+        r[i].status = 0;
+        r[i].t_tx = 0;
+        r[i].errors = 0;
+      }
+
+      uint64_t seq = h.seq0 - 1;
+      get_runs(in, n, [&](size_t i, uint64_t x) { seq += unzigzag(x) + 1; r[i].seq = seq; });
+      get_runs(in, n, [&](size_t i, uint64_t x) { r[i].size = x; });
+
+      if(kind == log_rx)
+      {
+        get_runs(in, n, [&](size_t i, uint64_t x) { r[i].status = x; });
+        get_runs(in, n, [&](size_t i, uint64_t x) { r[i].errors = x; });
+        int64_t offset = 0;
+        for(size_t i = 0; i < n; i ++)
+        {
+          offset += unzigzag(in.get());
+          r[i].t_tx = r[i].t + offset;
+        }
+      }
+
+      uint32_t index = 0;
+      for(size_t i = 0; i < missing.size(); i ++)
+      {
+        index += in.get();
+        missing[i].index = index;
+        missing[i].count = in.get();
+        missing[i].first = in.get();
+        missing[i].last = in.get();
+      }
+
+      if(in.p != in.end) throw corrupt();
+    }
+    catch(corrupt&)
+    {
+      throw runtime_error("Corrupt compressed log block");
+    }
+  }
+
+  const char *text_header(log_kind kind)
+  {
+    return kind == log_tx ? "t_tx size seq" : "t_rx size status seq t_tx errors";
+  }
+
+  void write_text(ostream& out, log_kind kind, const log_record& r)
+  {
+    if(kind == log_tx)
+      out << r.t << " " << r.size << " " << r.seq << "\n";
+    else
+      out << r.t << " " << r.size << " " << rx_status_name(r.status) << " " << r.seq << " " << r.t_tx << " " << r.errors << "\n";
+  }
+
+  void write_text(ostream& out, const log_missing& m)
+  {
+    out << "# missing " << m.count << " " << m.first << " " << m.last << "\n";
+  }
+
+  void write_text(ostream& out, log_kind kind, const vector<log_record>& r, const vector<log_missing>& missing)
+  {
+    size_t j = 0;
+
+    for(size_t i = 0; i < r.size(); i ++)
+    {
+      for(; j < missing.size() && missing[j].index == i; j ++) write_text(out, missing[j]);
+      write_text(out, kind, r[i]);
+    }
+    for(; j < missing.size(); j ++) write_text(out, missing[j]);
+  }
+};
+
+bool compressed_log_reader::is_compressed(const string& path)
+{
+  ifstream in(path.c_str(), ios::binary);
+  char magic[8];
+  return in.read(magic, sizeof(magic)) && memcmp(magic, "UDPTLOGZ", sizeof(magic)) == 0;
+}
+
+compressed_log_reader::compressed_log_reader(const string& path) : file(path)
+{
+  using namespace log_codec;
+
+  file_header fh;
+  if(file.size() < sizeof(fh)) throw runtime_error(path + " is not a compressed log");
+  memcpy(&fh, file.data(), sizeof(fh));
+  if(memcmp(fh.magic, "UDPTLOGZ", sizeof(fh.magic)) != 0 || fh.kind > log_rx)
+    throw runtime_error(path + " is not a compressed log");
+  if(fh.version != version) throw runtime_error(path + " has an unsupported version");
+  kind_ = log_kind(fh.kind);
+
+  // Only the block headers are read here
+  size_t o = sizeof(fh);
+  while(o < file.size())
+  {
+    block_header h;
+    if(file.size() - o < sizeof(h)) throw runtime_error(path + " is truncated");
+    memcpy(&h, file.data() + o, sizeof(h));
+    if(h.magic != block_magic) throw runtime_error(path + " has a corrupt block header");
+    if(file.size() - o - sizeof(h) < h.bytes) throw runtime_error(path + " is truncated");
+    offsets.push_back(o);
+    o += sizeof(h) + h.bytes;
+  }
+}
+
+void compressed_log_reader::decode(size_t i, vector<log_record>& records, vector<log_missing>& missing) const
+{
+  log_codec::block_header h;
+  memcpy(&h, file.data() + offsets[i], sizeof(h));
+  log_codec::decode_block(kind_, h, file.data() + offsets[i] + sizeof(h), records, missing);
+}
+
+void compressed_log_reader::write_text(ostream& out, nat threads) const
+{
+  if(threads == 0) threads = 1;
+  out << log_codec::text_header(kind_) << "\n";
+
+  // Decode and format a wave of blocks in parallel, then output it in order
+  const size_t wave = 4 * threads;
+  vector<string> texts(wave);
+
+  for(size_t b0 = 0; b0 < blocks(); b0 += wave)
+  {
+    const size_t b1 = min(blocks(), b0 + wave);
+    vector<thread> workers;
+    vector<exception_ptr> errors(threads);
+
+    for(nat k = 0; k < threads; k ++)
+    {
+      workers.push_back(thread([&, k]()
+      {
+        try
+        {
+          vector<log_record> records;
+          vector<log_missing> missing;
+          for(size_t b = b0 + k; b < b1; b += threads)
+          {
+            decode(b, records, missing);
+            stringstream u;
+            log_codec::write_text(u, kind_, records, missing);
+            texts[b - b0] = u.str();
+          }
+        }
+        catch(...)
+        {
+          errors[k] = current_exception();
+        }
+      }));
+    }
+
+    for(nat k = 0; k < threads; k ++) workers[k].join();
+    for(nat k = 0; k < threads; k ++) if(errors[k]) rethrow_exception(errors[k]);
+    for(size_t b = b0; b < b1; b ++) out << texts[b - b0];
+  }
+}
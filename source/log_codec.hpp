@@ -0,0 +1,117 @@
+// log_codec.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef LOG_CODEC_HPP_20261019
+#define LOG_CODEC_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shorthands.hpp"
+#include "mapped_file.hpp"
+
+/// One line of a transmission or reception log.  Transmission logs only use
+/// t, size and seq.
+struct log_record
+{
+  int64_t t;       // Transmission or reception time in microseconds
+  uint32_t size;   // UDP payload size
+  uint32_t status; // Reception status, see rx_status.hpp
+  uint64_t seq;    // Sequence number
+  uint64_t t_tx;   // Transmission time according to the sender
+  uint32_t errors; // Payload byte errors
+};
+
+/// A range of missing sequence numbers, detected just before record index.
+struct log_missing
+{
+  uint32_t index;
+  uint32_t count, first, last;
+};
+
+enum log_kind { log_tx = 0, log_rx = 1 };
+
+/// \brief Compressed log format.
+///
+/// A compressed log starts with a file header and is followed by independent
+/// blocks of at most block_records records, each with a block header giving
+/// its size, so that a reader can seek to any block and decode blocks in
+/// parallel.  Within a block, each field is stored as a column: times as
+/// zig-zag varint deltas, sequence number increments, sizes, statuses and
+/// error counts as run-length encoded varints, and the offset between the
+/// transmission and reception times as a zig-zag varint delta.
+namespace log_codec
+{
+  enum { block_records = 65536 };
+
+  struct file_header
+  {
+    char magic[8];   // "UDPTLOGZ"
+    uint32_t kind;   // log_kind
+    uint32_t version;
+  };
+
+  struct block_header
+  {
+    uint32_t magic;   // block_magic
+    uint32_t records;
+    uint32_t missing;
+    uint32_t bytes;   // Size of the encoded columns following the header
+    int64_t t0;
+    uint64_t seq0;
+  };
+
+  enum { block_magic = 0x4b4c4254, version = 1 };
+
+  /// Encode a block, appending its header and columns to out.
+  void encode_block(log_kind kind, const log_record *records, size_t n,
+                    const log_missing *missing, size_t n_missing, std::vector<char>& out);
+
+  /// Decode the columns of a block.
+  /// \throws std::runtime_error if the block is corrupt
+  void decode_block(log_kind kind, const block_header& h, const char *p,
+                    std::vector<log_record>& records, std::vector<log_missing>& missing);
+
+  /// Format one record in the text log format.
+  void write_text(std::ostream& out, log_kind kind, const log_record& r);
+
+  /// Format a missing range in the text log format.
+  void write_text(std::ostream& out, const log_missing& m);
+
+  /// Format records in the text log format, without the column header line.
+  void write_text(std::ostream& out, log_kind kind,
+                  const std::vector<log_record>& records, const std::vector<log_missing>& missing);
+
+  /// Return the column header line of text logs.
+  const char *text_header(log_kind kind);
+};
+
+/// \brief Random access reader for compressed logs.
+class compressed_log_reader
+{
+  mapped_file file;
+  log_kind kind_;
+  std::vector<size_t> offsets;
+
+public:
+  /// \throws std::runtime_error if the file is not a compressed log
+  explicit compressed_log_reader(const std::string& path);
+
+  /// Return true if the file starts like a compressed log.
+  static bool is_compressed(const std::string& path);
+
+  log_kind kind() const { return kind_; }
+  size_t blocks() const { return offsets.size(); }
+
+  /// Decode block i.
+  void decode(size_t i, std::vector<log_record>& records, std::vector<log_missing>& missing) const;
+
+  /// Write the whole log in the text format, decoding blocks with the given
+  /// number of threads.
+  void write_text(std::ostream& out, nat threads) const;
+};
+
+#endif
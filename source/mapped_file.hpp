@@ -0,0 +1,76 @@
+// mapped_file.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef MAPPED_FILE_HPP_20261019
+#define MAPPED_FILE_HPP_20261019
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// \brief Read-only memory mapping of a whole file.
+class mapped_file
+{
+  const char *data_;
+  size_t size_;
+
+  mapped_file(const mapped_file&);
+  mapped_file& operator=(const mapped_file&);
+
+public:
+  /// \throws std::runtime_error if the file cannot be mapped
+  explicit mapped_file(const std::string& path) : data_(NULL), size_(0)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+    {
+      close(fd);
+      throw std::runtime_error("Cannot stat " + path + ": " + strerror(errno));
+    }
+
+    size_ = st.st_size;
+    if(size_ > 0)
+    {
+      void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(p == MAP_FAILED)
+      {
+        close(fd);
+        throw std::runtime_error("Cannot map " + path + ": " + strerror(errno));
+      }
+      madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(p);
+    }
+    close(fd);
+  }
+
+  ~mapped_file()
+  {
+    if(data_) munmap(const_cast<char *>(data_), size_);
+  }
+
+  /// Release the whole pages of [p, end) from the resident set.  They are
+  /// read again from the file if accessed later.
+  void drop(const char *p, const char *end) const
+  {
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t a = (reinterpret_cast<uintptr_t>(p) + page - 1) & ~(page - 1);
+    const uintptr_t b = reinterpret_cast<uintptr_t>(end) & ~(page - 1);
+    if(a < b) madvise(reinterpret_cast<void *>(a), b - a, MADV_DONTNEED);
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+};
+
+#endif
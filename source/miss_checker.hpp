@@ -0,0 +1,102 @@
+// miss_checker.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef MISS_CHECKER_HPP_20261019
+#define MISS_CHECKER_HPP_20261019
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "shorthands.hpp"
+
+/// \brief Detect lost and duplicate sequence numbers.
+/// The last m distinct sequence numbers are kept sorted.  When a new one
+/// arrives and m are already kept, the smallest is retired, and the sequence
+/// numbers between it and the next smallest are declared missing.  The window
+/// lives in a fixed array of 2m entries, so that adding never allocates and
+/// retiring the smallest is a pointer increment.
+class miss_checker
+{
+  std::vector<uint32_t> seen; // Sorted window in [begin, end)
+  size_t begin, end;
+  const nat m;
+  uint64_t duplicates, missing, original;
+
+public:
+  struct result
+  {
+    bool is_duplicate;
+    bool some_missing;
+    nat first_missing, last_missing;
+
+    result() : is_duplicate(false), some_missing(false), first_missing(0), last_missing(0) { }
+  };
+
+  miss_checker(nat m_) :
+    seen(2 * std::max<nat>(m_, 1)),
+    begin(0),
+    end(0),
+    m(std::max<nat>(m_, 1)),
+    duplicates(0),
+    missing(0),
+    original(0)
+  {
+  }
+
+  void remove(result& r)
+  {
+    if(end - begin >= 2)
+    {
+      uint32_t s0 = seen[begin],
+               s1 = seen[begin + 1];
+      nat num_missing = s1 - s0 - 1;
+      if(num_missing > 0)
+      {
+        missing += num_missing;
+        r.some_missing = true;
+        r.first_missing = s0 + 1;
+        r.last_missing = s1 - 1;
+      }
+    }
+    begin ++;
+  }
+
+  result add(nat seq)
+  {
+    result r;
+    uint32_t *data = seen.data();
+
+    if(std::binary_search(data + begin, data + end, seq))
+    {
+      duplicates ++;
+      r.is_duplicate = true;
+      return r;
+    }
+
+    original ++;
+    if(end - begin == m) remove(r);
+
+    if(end == seen.size())
+    {
+      memmove(data, data + begin, (end - begin) * sizeof(*data));
+      end -= begin;
+      begin = 0;
+    }
+
+    // In-order arrivals go at the end, so that nothing is moved
+    uint32_t *it = std::lower_bound(data + begin, data + end, seq);
+    memmove(it + 1, it, (data + end - it) * sizeof(*data));
+    *it = seq;
+    end ++;
+    return r;
+  }
+
+  uint64_t get_duplicates() const { return duplicates; }
+  uint64_t get_missing()    const { return missing; }
+  uint64_t get_original()   const { return original; }
+};
+
+#endif
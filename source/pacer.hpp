@@ -0,0 +1,71 @@
+// pacer.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PACER_HPP_20261019
+#define PACER_HPP_20261019
+
+#include <time.h>
+#include <errno.h>
+#include <stdexcept>
+
+#include "shorthands.hpp"
+
+/// \brief Wait for absolute deadlines on the CLOCK_MONOTONIC clock.
+/// Times are in nanoseconds relative to the construction of the pacer.  For
+/// precise pacing, the pacer sleeps until shortly before the deadline and
+/// spins for the remaining time.
+class pacer
+{
+  int64_t t0, spin;
+
+public:
+  static int64_t now()
+  {
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts))
+    {
+      throw std::runtime_error("Cannot get CLOCK_MONOTONIC clock");
+    }
+    return 1000000000 * (int64_t) ts.tv_sec + ts.tv_nsec;
+  }
+
+  /// \param spin_ Spin for this many nanoseconds before deadlines
+  explicit pacer(int64_t spin_=0) : t0(now()), spin(spin_) { }
+
+  /// Pacer sharing the time origin of another.
+  pacer(const pacer& origin, int64_t spin_) : t0(origin.t0), spin(spin_) { }
+
+  /// Return the time elapsed since construction, in nanoseconds.
+  int64_t elapsed() const { return now() - t0; }
+
+  /// Sleep until the given time, in nanoseconds since construction.
+  /// \returns False if the time had already passed, i.e. the caller overran
+  bool wait_until(int64_t t) const
+  {
+    const int64_t t_abs = t0 + t, t_now = now();
+    if(t_now >= t_abs) return false;
+    if(spin > 0)
+    {
+      if(t_abs - t_now > spin) sleep_until(t_abs - spin);
+      while(now() < t_abs) { }
+    }
+    else
+    {
+      sleep_until(t_abs);
+    }
+    return true;
+  }
+
+private:
+  static void sleep_until(int64_t t_abs)
+  {
+    struct timespec ts;
+    ts.tv_sec  = t_abs / 1000000000;
+    ts.tv_nsec = t_abs % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+  }
+};
+
+#endif
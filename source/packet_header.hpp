@@ -4,9 +4,10 @@
 // vim:set ts=2 sw=2 foldmarker={,}:
 
 #ifndef PACKET_HEADER_HPP_20100721
-#define PACKET_HEADER_HPP_20100721o
+#define PACKET_HEADER_HPP_20100721
 
 #include <iostream>
+#include <cstring>
 #include "network_word.hpp"
 
 struct packet_header
@@ -44,6 +45,32 @@ struct packet_header
     }
   }
 
+  /// Decode a header directly from a buffer holding at least encoded_size bytes.
+  explicit packet_header(const char *buffer)
+  {
+    uint32_t sequence_n, timestamp_n;
+    uint16_t size_n, check_n;
+    memcpy(&sequence_n,  buffer,      sizeof(sequence_n));
+    memcpy(&timestamp_n, buffer + 4,  sizeof(timestamp_n));
+    memcpy(&size_n,      buffer + 8,  sizeof(size_n));
+    memcpy(&check_n,     buffer + 10, sizeof(check_n));
+    sequence  = be32toh(sequence_n);
+    timestamp = be32toh(timestamp_n);
+    size      = be16toh(size_n);
+    check     = be16toh(check_n);
+  }
+
+  /// Encode the header directly into a buffer of at least encoded_size bytes.
+  void encode(char *buffer) const
+  {
+    const uint32_t sequence_n = htobe32(sequence), timestamp_n = htobe32(timestamp);
+    const uint16_t size_n = htobe16(size), check_n = htobe16(check);
+    memcpy(buffer,      &sequence_n,  sizeof(sequence_n));
+    memcpy(buffer + 4,  &timestamp_n, sizeof(timestamp_n));
+    memcpy(buffer + 8,  &size_n,      sizeof(size_n));
+    memcpy(buffer + 10, &check_n,     sizeof(check_n));
+  }
+
   void encode(std::ostream& out, size_t &m)
   {
     using namespace network_word;
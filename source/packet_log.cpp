@@ -0,0 +1,189 @@
+// packet_log.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <stdexcept>
+#include <iomanip>
+#include <limits>
+#include <time.h>
+
+#include "packet_log.hpp"
+#include "rx_status.hpp"
+
+using namespace std;
+
+packet_log::ptr packet_log::create(format f, log_kind kind, const string& path, const log_mode& mode)
+{
+  if(mode.bin_interval > 0) return ptr(new binned_packet_log(kind, path, mode.bin_interval));
+  if(f == compressed) return ptr(new compressed_packet_log(kind, path));
+  return ptr(new text_packet_log(kind, path));
+}
+
+text_packet_log::text_packet_log(log_kind kind_, const string& path) :
+  out(path.c_str()),
+  kind(kind_)
+{
+  if(!out) throw runtime_error("Cannot create log file " + path);
+  out << log_codec::text_header(kind) << endl;
+}
+
+void text_packet_log::add(const log_record& r)
+{
+  log_codec::write_text(out, kind, r);
+}
+
+void text_packet_log::missing(uint32_t count, uint32_t first, uint32_t last)
+{
+  const log_missing m = { 0, count, first, last };
+  log_codec::write_text(out, m);
+}
+
+compressed_packet_log::compressed_packet_log(log_kind kind_, const string& path) :
+  out(path.c_str(), ios::binary),
+  kind(kind_)
+{
+  if(!out) throw runtime_error("Cannot create log file " + path);
+
+  log_codec::file_header h;
+  memcpy(h.magic, "UDPTLOGZ", sizeof(h.magic));
+  h.kind = kind;
+  h.version = log_codec::version;
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+  records.reserve(log_codec::block_records);
+  missing_.reserve(log_codec::block_records + 1);
+  encoded.reserve(8 * log_codec::block_records);
+}
+
+compressed_packet_log::~compressed_packet_log()
+{
+  flush();
+}
+
+void compressed_packet_log::flush()
+{
+  if(records.empty() && missing_.empty()) return;
+  encoded.clear();
+  log_codec::encode_block(kind, records.data(), records.size(), missing_.data(), missing_.size(), encoded);
+  out.write(encoded.data(), encoded.size());
+  records.clear();
+  missing_.clear();
+}
+
+void compressed_packet_log::add(const log_record& r)
+{
+  if(records.size() == log_codec::block_records) flush();
+  records.push_back(r);
+}
+
+void compressed_packet_log::missing(uint32_t count, uint32_t first, uint32_t last)
+{
+  log_missing m;
+  m.index = records.size();
+  m.count = count;
+  m.first = first;
+  m.last = last;
+  missing_.push_back(m);
+}
+
+binned_packet_log::binned_packet_log(log_kind kind_, const string& path, int64_t interval_) :
+  out(path.c_str()),
+  kind(kind_),
+  interval(interval_),
+  started(false),
+  have_delay(false),
+  wall_offset(0),
+  bin_start(0),
+  delay_origin(0),
+  last_delay(0)
+{
+  if(!out) throw runtime_error("Cannot create log file " + path);
+  out << (kind == log_tx ? "t packets bytes" :
+                           "t packets bytes lost dup ooo damaged errors delay_min delay_mean delay_max jitter") << endl;
+  reset();
+}
+
+binned_packet_log::~binned_packet_log()
+{
+  if(started) write_bin();
+}
+
+void binned_packet_log::reset()
+{
+  packets = bytes = lost = dup = ooo = damaged = errors = delays = jitters = 0;
+  delay_min = numeric_limits<int64_t>::max();
+  delay_max = numeric_limits<int64_t>::min();
+  delay_sum = jitter_sum = 0;
+}
+
+void binned_packet_log::write_bin()
+{
+  out << bin_start / 1000000 << "." << setw(6) << setfill('0') << bin_start % 1000000 << setfill(' ')
+      << " " << packets << " " << bytes;
+  if(kind == log_rx)
+  {
+    out << " " << lost << " " << dup << " " << ooo << " " << damaged << " " << errors;
+    if(delays > 0) out << " " << delay_min << " " << delay_sum / delays << " " << delay_max;
+    else out << " NA NA NA";
+    if(jitters > 0) out << " " << jitter_sum / jitters;
+    else out << " NA";
+  }
+  // Rows are rare enough to be flushed, so that nothing is lost if the run is killed
+  out << endl;
+  reset();
+}
+
+void binned_packet_log::add(const log_record& r)
+{
+  if(!started)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    wall_offset = 1000000 * int64_t(ts.tv_sec) + ts.tv_nsec / 1000 - r.t;
+    bin_start = (r.t + wall_offset) / interval * interval;
+    started = true;
+  }
+
+  const int64_t wall = r.t + wall_offset;
+  while(wall >= bin_start + interval)
+  {
+    write_bin();
+    bin_start += interval;
+  }
+
+  packets ++;
+  bytes += r.size;
+  if(kind == log_tx) return;
+
+  if(r.status & rx_dup) dup ++;
+  if(r.status & rx_ooo) ooo ++;
+  if(r.status & rx_damaged) damaged ++;
+  errors += r.errors;
+
+  if(!(r.status & (rx_damaged | rx_dup)))
+  {
+    // Headers carry the low 32 bits of the transmission time
+    const uint32_t raw = uint32_t(r.t) - uint32_t(r.t_tx);
+    if(!have_delay) delay_origin = raw;
+    const int64_t d = int32_t(raw - delay_origin);
+
+    delays ++;
+    delay_sum += d;
+    delay_min = min(delay_min, d);
+    delay_max = max(delay_max, d);
+    if(have_delay)
+    {
+      jitters ++;
+      jitter_sum += d > last_delay ? d - last_delay : last_delay - d;
+    }
+    last_delay = d;
+    have_delay = true;
+  }
+}
+
+void binned_packet_log::missing(uint32_t count, uint32_t first, uint32_t last)
+{
+  lost += count;
+}
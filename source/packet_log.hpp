@@ -0,0 +1,110 @@
+// packet_log.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PACKET_LOG_HPP_20261019
+#define PACKET_LOG_HPP_20261019
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "log_codec.hpp"
+
+/// Logging granularity selected with --log-mode.
+struct log_mode
+{
+  int64_t bin_interval; // Microseconds per bin, or 0 to log every packet
+
+  explicit log_mode(int64_t bin_interval_=0) : bin_interval(bin_interval_) { }
+};
+
+/// \brief Per-packet transmission or reception log.
+class packet_log
+{
+public:
+  enum format { text, compressed };
+
+  typedef boost::shared_ptr<packet_log> ptr;
+  virtual ~packet_log() { }
+
+  /// Log a packet.
+  virtual void add(const log_record& r) = 0;
+
+  /// Log a range of missing sequence numbers, detected before the next packet.
+  virtual void missing(uint32_t count, uint32_t first, uint32_t last) = 0;
+
+  /// Open a log of the given format, or a binned log if the mode says so.
+  /// \throws std::runtime_error if the file cannot be created
+  static ptr create(format f, log_kind kind, const std::string& path, const log_mode& mode=log_mode());
+};
+
+/// \brief Log in the text format, readable by R.
+class text_packet_log : public packet_log
+{
+  std::ofstream out;
+  log_kind kind;
+
+public:
+  text_packet_log(log_kind kind, const std::string& path);
+  void add(const log_record& r);
+  void missing(uint32_t count, uint32_t first, uint32_t last);
+};
+
+/// \brief Log in the compressed format described in log_codec.hpp.
+class compressed_packet_log : public packet_log
+{
+  std::ofstream out;
+  log_kind kind;
+  std::vector<log_record> records;
+  std::vector<log_missing> missing_;
+  std::vector<char> encoded;
+
+  void flush();
+
+public:
+  compressed_packet_log(log_kind kind, const std::string& path);
+  ~compressed_packet_log();
+  void add(const log_record& r);
+  void missing(uint32_t count, uint32_t first, uint32_t last);
+};
+
+/// \brief Log of per-bin aggregates, in the text format readable by R.
+///
+/// Bins are aligned on multiples of the interval in wall-clock time, so that
+/// the bins of a transmitter and a receiver with synchronized clocks line up.
+/// Record times are mapped to wall-clock time with the offset measured at the
+/// first record.  A row is written when the first record of a later bin
+/// arrives, with empty rows for the bins in between, and on destruction.
+/// Reception delays are one-way delays relative to that of the first packet,
+/// since the clocks of both ends have an unknown offset, and jitter is the
+/// mean absolute difference between the delays of consecutive packets.
+class binned_packet_log : public packet_log
+{
+  std::ofstream out;
+  log_kind kind;
+  const int64_t interval;
+  bool started, have_delay;
+  int64_t wall_offset, bin_start;
+  uint32_t delay_origin;
+  int64_t last_delay;
+
+  // Aggregates of the current bin
+  uint64_t packets, bytes, lost, dup, ooo, damaged, errors, delays, jitters;
+  int64_t delay_min, delay_max;
+  double delay_sum, jitter_sum;
+
+  void reset();
+  void write_bin();
+
+public:
+  binned_packet_log(log_kind kind, const std::string& path, int64_t interval);
+  ~binned_packet_log();
+  void add(const log_record& r);
+  void missing(uint32_t count, uint32_t first, uint32_t last);
+};
+
+#endif
@@ -0,0 +1,101 @@
+// packet_receiver.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cmath>
+#include <algorithm>
+
+#include "packet_receiver.hpp"
+
+using namespace std;
+
+void packet_receiver::output(ostream& out) const
+{
+  if(!count)
+  {
+    out << "No packets received";
+    return;
+  }
+
+  double dt = (t_last - t_first)/1e6;
+
+  uint64_t original   = mc.get_original(),
+           missing    = mc.get_missing(),
+           duplicates = mc.get_duplicates(); 
+
+  double p_loss_ratio = double(missing) / double(missing + original);
+
+  string verification = verify.name();
+  if(integrity == integrity_crc32c) verification += string(" (crc32c, ") + crc32c_implementation() + ")";
+
+  out <<
+    "RX statistics:\n"
+    "  Total packets ............................ " << count                  << " pk\n"
+    "  Total bytes .............................. " << byte_count             << " B\n"
+    "  Time ..................................... " << dt                     << " s\n"
+    "  Packet rate .............................. " << count / dt             << " pk/s\n"
+    "  Bandwidth ................................ " << 8e-6 * byte_count / dt << " Mbit/s\n"
+    "  Packets with bad checksum ................ " << bad_checksum           << " pk\n";
+
+  if(integrity == integrity_crc32c) out <<
+    "  Packets failing CRC32C ................... " << crc_failures           << " pk\n";
+
+  out <<
+    "  Truncated packets ........................ " << truncated              << " pk\n"
+    "  Lowest sequence # ........................ " << seq_min                << "\n"
+    "  Highest sequence # ....................... " << seq_max                << "\n"
+    "  Out of order packets ..................... " << out_of_order           << " pk\n"
+    "  Decodable packets ........................ " << decodable_count        << " pk\n"
+    "  Decodable loss ratio ..................... " << p_loss_ratio           << "\n"
+    "  Original decodables ...................... " << original               << " pk\n"
+    "  Lost decodables .......................... " << missing                << " pk\n"
+    "  Duplicate decodables ..................... " << duplicates             << " pk\n"
+    "  Payload verification ..................... " << verification           << "\n"
+    "  Verified payloads ........................ " << verified_count         << " pk, " << verified_bytes << " B";
+
+  // A CRC only tells whether a payload is intact, not how many bits differ
+  if(integrity == integrity_crc32c) return;
+
+  out << "\n"
+    "  Payload byte errors ...................... " << total_errors           << " B\n"
+    "  Decodables with erroneous payloads........ " << total_erroneous        << " pk"
+  ;
+
+  if(verified_count > 0)
+  {
+    const double n = verified_count,
+                 sum_x = 8.0 * verified_bytes,
+                 ber = bit_errors / sum_x;
+
+    out << "\n"
+      "  Payload bit error rate ................... " << ber;
+
+    if(verified_count > 1 && verified_bytes < payload_bytes)
+    {
+      const double x_bar = sum_x / n,
+                   s2 = (sum_y2 - 2 * ber * sum_xy + ber * ber * sum_x2) / (n - 1),
+                   se = sqrt(max(0.0, s2) / n) / x_bar;
+
+      out << " +/- " << 1.96 * se << " (95%)\n"
+        "  Estimated payload bit errors ............. " << ber * 8.0 * payload_bytes << " bit";
+    }
+  }
+}
+
+packet_receiver::ptr packet_receiver::create(packet_log::ptr log, nat miss_window, const verify_mode& verify,
+                                             payload_integrity integrity)
+{
+  switch(verify.k)
+  {
+    case verify_mode::none:
+      return ptr(new verifying_packet_receiver<verify_none>(log, miss_window, verify, integrity, verify_none()));
+    case verify_mode::header:
+      return ptr(new verifying_packet_receiver<verify_header>(log, miss_window, verify, integrity, verify_header()));
+    case verify_mode::sampled:
+      return ptr(new verifying_packet_receiver<verify_sampled>(log, miss_window, verify, integrity, verify_sampled(verify.every)));
+    case verify_mode::full:
+      break;
+  }
+  return ptr(new verifying_packet_receiver<verify_full>(log, miss_window, verify, integrity, verify_full()));
+}
@@ -0,0 +1,248 @@
+// packet_receiver.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PACKET_RECEIVER_HPP_20261019
+#define PACKET_RECEIVER_HPP_20261019
+
+#include <iostream>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "rtclock.hpp"
+#include "wprng.hpp"
+#include "packet_header.hpp"
+#include "packet_log.hpp"
+#include "miss_checker.hpp"
+#include "rx_status.hpp"
+#include "verify_policy.hpp"
+#include "crc32c.hpp"
+#include "stage_timer.hpp"
+#include "probes.hpp"
+
+/// \brief Check received packets, count anomalies and log them.
+class packet_receiver
+{
+protected:
+  packet_log::ptr log;
+  uint64_t seq_min, seq_max, seq_last, out_of_order, count, decodable_count,
+           byte_count, bad_checksum, truncated, total_errors, total_erroneous;
+  int64_t t_first, t_last;
+  rtclock clk;
+  miss_checker mc;
+  const verify_mode verify;
+  const payload_integrity integrity;
+  uint64_t crc_failures;
+
+  // Payload verification accumulators.  Each verified payload is a cluster of
+  // x_i = 8 * size bits among which y_i are in error; the bit error rate is
+  // estimated as the ratio sum(y_i) / sum(x_i) and its variance is computed
+  // using the usual ratio estimator formula.
+  uint64_t payload_bytes, verified_count, verified_bytes, bit_errors;
+  double sum_x2, sum_xy, sum_y2;
+
+  uint32_t check_payload(uint32_t seed, const char *payload, size_t m)
+  {
+    wprng w(seed);
+    uint32_t errors = 0, bits = 0;
+
+    for(nat i = 0; i < m; i ++)
+    {
+      uint8_t expected_byte, received_byte;
+
+      expected_byte = w.get();
+      received_byte = payload[i];
+
+      const uint8_t diff = expected_byte ^ received_byte;
+      errors += diff != 0;
+      bits += __builtin_popcount(diff);
+    }
+
+    const double x = 8.0 * m, y = bits;
+    verified_count ++;
+    verified_bytes += m;
+    bit_errors += bits;
+    sum_x2 += x * x;
+    sum_xy += x * y;
+    sum_y2 += y * y;
+
+    return errors;
+  }
+
+  /// Check the CRC32C trailer of a packet of m0 bytes.
+  bool check_crc(const char *buffer, size_t m0)
+  {
+    uint32_t crc_n;
+    memcpy(&crc_n, buffer + m0 - crc32c_size, sizeof(crc_n));
+    verified_count ++;
+    verified_bytes += m0 - packet_header::encoded_size;
+    return crc32c(buffer, m0 - crc32c_size) == be32toh(crc_n);
+  }
+
+public:
+  typedef boost::shared_ptr<packet_receiver> ptr;
+
+  packet_receiver(packet_log::ptr log_, nat miss_window, const verify_mode& verify_, payload_integrity integrity_) :
+    log(log_), seq_min(0), seq_max(0), seq_last(0), out_of_order(0),
+    count(0), decodable_count(0), byte_count(0), bad_checksum(0), truncated(0),
+    total_errors(0), total_erroneous(0), mc(miss_window), verify(verify_),
+    integrity(integrity_), crc_failures(0),
+    payload_bytes(0), verified_count(0), verified_bytes(0), bit_errors(0),
+    sum_x2(0), sum_xy(0), sum_y2(0)
+  {
+  }
+
+  virtual ~packet_receiver() { } 
+
+  /// Return the current time of the reception clock, in us.
+  int64_t get_time() { return clk.get(); }
+
+  /// Process a packet received now.
+  /// \returns The status of the packet, as a combination of rx_status bits
+  nat receive(const char *buffer, const size_t m0) { return receive_at(buffer, m0, clk.get()); }
+
+  /// Process a packet received at t_rx, in us on the clock of get_time().
+  /// For packets received by another thread.
+  virtual nat receive_at(const char *buffer, const size_t m0, int64_t t_rx) = 0;
+
+  /// Create a receiver whose receive pipeline is specialized for the given
+  /// verification mode.
+  static ptr create(packet_log::ptr log, nat miss_window, const verify_mode& verify,
+                    payload_integrity integrity=integrity_pattern);
+
+  uint64_t get_count()        const { return count; }
+  uint64_t get_bytes()        const { return byte_count; }
+  uint64_t get_missing()      const { return mc.get_missing(); }
+  uint64_t get_duplicates()   const { return mc.get_duplicates(); }
+  uint64_t get_out_of_order() const { return out_of_order; }
+
+  /// Return the number of packets with a bad checksum, truncated or with a damaged payload.
+  uint64_t get_damaged() const { return bad_checksum + truncated + total_erroneous + crc_failures; }
+
+  void output(std::ostream& out) const;
+
+  friend std::ostream& operator<<(std::ostream& out, const packet_receiver& self)
+  {
+    self.output(out);
+    return out;
+  }
+
+};
+
+template<class Verify>
+class verifying_packet_receiver : public packet_receiver
+{
+  Verify policy;
+
+public:
+  verifying_packet_receiver(packet_log::ptr log_, nat miss_window, const verify_mode& verify_,
+                            payload_integrity integrity_, const Verify& policy_) :
+    packet_receiver(log_, miss_window, verify_, integrity_),
+    policy(policy_)
+  {
+  }
+
+  nat receive_at(const char *buffer, const size_t m0, int64_t t_rx)
+  {
+    nat status = rx_ok;
+    uint32_t seq = 0;
+    uint64_t t_tx = 0;
+    uint32_t errors = 0;
+    STAGE_PACKET();
+
+    do
+    {
+      if(m0 < packet_header::encoded_size)
+      {
+        status = rx_short;
+        break;
+      }
+
+      if(!count)
+      {
+        t_first = t_rx;
+      }
+      t_last = t_rx;
+
+      STAGE_START(rx_parse);
+      const packet_header ph(buffer);
+      const bool bad = Verify::check_header && !ph.checksum_valid();
+      STAGE_STOP(rx_parse);
+
+      if(bad)
+      {
+        status = rx_bad;
+        bad_checksum ++;
+        break;
+      }
+
+      seq = ph.sequence;
+      if(!count || seq < seq_min) seq_min = seq;
+      if(!count || seq > seq_max) seq_max = seq;
+      if(count && seq < seq_last)
+      {
+        status |= rx_ooo;
+        out_of_order ++;
+      }
+      seq_last = seq;
+      STAGE_START(rx_miss);
+      miss_checker::result r = mc.add(seq);
+      STAGE_STOP(rx_miss);
+      if(r.is_duplicate) status |= rx_dup;
+      if(r.some_missing)
+      {
+        log->missing(r.last_missing - r.first_missing + 1, r.first_missing, r.last_missing);
+        PROBE3(gap, r.first_missing, r.last_missing, r.last_missing - r.first_missing + 1);
+      }
+
+      t_tx = ph.timestamp;
+
+      const size_t m = m0 - packet_header::encoded_size;
+
+      if(Verify::check_header && ph.size != m)
+      {
+        truncated ++;
+        status |= rx_trunc;
+        break;
+      }
+      
+      decodable_count ++;
+      payload_bytes += m;
+
+      STAGE_START(rx_verify);
+      if(Verify::check_payload && integrity == integrity_crc32c)
+      {
+        if(m >= crc32c_size && policy.sample() && !check_crc(buffer, m0))
+        {
+          status |= rx_crc;
+          crc_failures ++;
+        }
+      }
+      else if(Verify::check_payload && policy.sample())
+      {
+        errors = check_payload(ph.check, buffer + packet_header::encoded_size, m);
+        if(errors > 0)
+        {
+          status |= rx_ber;
+          total_erroneous ++;
+          total_errors += errors;
+        }
+      }
+      STAGE_STOP(rx_verify);
+    }
+    while(false);
+
+    byte_count += m0;
+    count ++;
+
+    STAGE_START(rx_log);
+    const log_record lr = { t_rx, uint32_t(m0), status, seq, t_tx, errors };
+    log->add(lr);
+    STAGE_STOP(rx_log);
+    PROBE4(receive, seq, m0, status, int32_t(uint32_t(t_rx) - uint32_t(t_tx)));
+    return status;
+  }
+};
+
+#endif
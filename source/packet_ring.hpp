@@ -0,0 +1,104 @@
+// packet_ring.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PACKET_RING_HPP_20261019
+#define PACKET_RING_HPP_20261019
+
+#include <vector>
+#include <atomic>
+#include <time.h>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+
+/// \brief Lock-free ring of preallocated packets between one producer thread
+/// and one consumer thread, used from the transmission schedule to the
+/// sending thread and from the receiving thread to verification workers.
+/// The producer builds a packet in the slot returned by back() and publishes
+/// it with push(); the consumer reads the oldest packets with front() and
+/// frees them with pop().  Each index is written by one side only, with
+/// release ordering, and read by the other with acquire ordering.
+class packet_ring
+{
+  enum { cache_line = 64 };
+
+public:
+  struct slot
+  {
+    char *data;
+    size_t size;
+    int64_t t;          // Scheduled time in ns on transmission, reception time in us on reception
+    uint64_t seq;       // Sequence number on transmission
+    nat flow;           // Socket index on reception
+    struct timespec ts; // Wall-clock reception time, for captures
+  };
+
+private:
+  std::vector<char> arena;
+  std::vector<slot> slots;
+  const uint64_t mask;
+  // Each index on its own cache line
+  char pad0[cache_line];
+  std::atomic<uint64_t> head; // Next slot to consume, written by the consumer
+  char pad1[cache_line - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> tail; // Next slot to produce, written by the producer
+  char pad2[cache_line - sizeof(std::atomic<uint64_t>)];
+
+  static uint64_t round_up(uint64_t n)
+  {
+    uint64_t p = 1;
+    while(p < n) p <<= 1;
+    return p;
+  }
+
+public:
+  typedef boost::shared_ptr<packet_ring> ptr;
+
+  /// \param n         Number of packets, rounded up to a power of two
+  /// \param slot_size Largest packet size
+  packet_ring(size_t n, size_t slot_size) :
+    arena(round_up(n) * slot_size),
+    slots(round_up(n)),
+    mask(round_up(n) - 1),
+    head(0),
+    tail(0)
+  {
+    for(size_t i = 0; i < slots.size(); i ++) slots[i].data = &arena[i * slot_size];
+  }
+
+  size_t capacity() const { return slots.size(); }
+
+  /// Return the slot to fill next, or NULL if the ring is full.  Producer only.
+  slot *back()
+  {
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) > mask) return NULL;
+    return &slots[t & mask];
+  }
+
+  /// Publish the slot returned by back().  Producer only.
+  void push() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  /// Return the number of packets ready to consume, or not yet freed by the
+  /// consumer when called by the producer.
+  size_t available() const
+  {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  /// Return the scheduled time of the oldest packet of a full ring.  Producer only.
+  int64_t oldest_time() const { return slots[head.load(std::memory_order_acquire) & mask].t; }
+
+  /// Return the k-th oldest packet, with k < available().  Consumer only.
+  const slot& front(size_t k=0) const { return slots[(head.load(std::memory_order_relaxed) + k) & mask]; }
+
+  /// Free the n oldest packets.  Consumer only.
+  void pop(size_t n) { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  /// Drop all packets.  Only when neither side is running.
+  void clear() { head.store(tail.load()); }
+};
+
+#endif
@@ -0,0 +1,84 @@
+// packet_transmitter.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PACKET_TRANSMITTER_HPP_20261019
+#define PACKET_TRANSMITTER_HPP_20261019
+
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "rtclock.hpp"
+#include "wprng.hpp"
+#include "packet_header.hpp"
+#include "packet_log.hpp"
+#include "verify_policy.hpp"
+#include "crc32c.hpp"
+#include "stage_timer.hpp"
+#include "probes.hpp"
+
+/// \brief Build numbered, timestamped packets and log them.
+class packet_transmitter
+{
+  packet_log::ptr log;
+  const payload_integrity integrity;
+  uint64_t seq;
+  rtclock clk;
+
+public:
+  typedef boost::shared_ptr<packet_transmitter> ptr;
+
+  explicit packet_transmitter(packet_log::ptr log_, payload_integrity integrity_=integrity_pattern) :
+    log(log_), integrity(integrity_), seq(0) { }
+
+  virtual ~packet_transmitter() { }
+
+  /// Return the sequence number of the next packet.
+  uint64_t get_sequence() const { return seq; }
+
+  /// Return the current time of the transmission clock, in us.
+  int64_t get_time() { return clk.get(); }
+
+  /// Build the next packet of m0 bytes into buffer.  Packets too short to
+  /// hold a header are left alone but logged.
+  void transmit(char *buffer, const size_t m0) { transmit_at(buffer, m0, clk.get()); }
+
+  /// Build the next packet, stamped with the transmission time t_tx in us on
+  /// the clock of get_time().  For packets built ahead of their sending time.
+  void transmit_at(char *buffer, const size_t m0, int64_t t_tx)
+  {
+    STAGE_PACKET();
+    STAGE_START(tx_log);
+    log_record r = { t_tx, uint32_t(m0), 0, seq, 0, 0 };
+    log->add(r);
+    STAGE_STOP(tx_log);
+    if(m0 < packet_header::encoded_size) return;
+    STAGE_START(tx_encode);
+    encode(buffer, m0, seq, t_tx, integrity);
+    STAGE_STOP(tx_encode);
+    seq ++;
+  }
+
+  /// Write a packet of m0 >= packet_header::encoded_size bytes, header and
+  /// payload.  With integrity_crc32c, the last crc32c_size bytes of payloads
+  /// long enough to hold them are replaced by the CRC32C of the rest of the
+  /// packet, in network order.
+  static void encode(char *buffer, const size_t m0, uint32_t seq, uint32_t t_tx,
+                     payload_integrity integrity=integrity_pattern)
+  {
+    const size_t m = m0 - packet_header::encoded_size;
+    const packet_header ph(t_tx, m, seq);
+    ph.encode(buffer);
+    wprng w(ph.check);
+    char *payload = buffer + packet_header::encoded_size;
+    for(size_t i = 0; i < m; i ++) payload[i] = w.get();
+    if(integrity == integrity_crc32c && m >= crc32c_size)
+    {
+      const uint32_t crc_n = htobe32(crc32c(buffer, m0 - crc32c_size));
+      memcpy(buffer + m0 - crc32c_size, &crc_n, sizeof(crc_n));
+    }
+  }
+};
+
+#endif
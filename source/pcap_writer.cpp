@@ -0,0 +1,211 @@
+// pcap_writer.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include "pcap_writer.hpp"
+#include "probes.hpp"
+
+using namespace std;
+
+namespace
+{
+  enum
+  {
+    ethernet_size    = 14,
+    ipv4_size        = 20,
+    ipv6_size        = 40,
+    udp_size         = 8,
+    record_size      = 16,
+    max_headers      = ethernet_size + ipv6_size + udp_size,
+    linktype_ethernet = 1
+  };
+
+  inline void put16(char *p, uint16_t x) { x = htobe16(x); memcpy(p, &x, 2); }
+  inline void put32(char *p, uint32_t x) { x = htobe32(x); memcpy(p, &x, 4); }
+
+  uint16_t ip_checksum(const char *p, size_t n)
+  {
+    uint32_t sum = 0;
+    for(size_t i = 0; i < n; i += 2)
+    {
+      sum += (uint8_t(p[i]) << 8) | uint8_t(p[i + 1]);
+    }
+    while(sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+  }
+
+  bool write_all(int fd, const char *p, size_t n)
+  {
+    while(n > 0)
+    {
+      ssize_t r = ::write(fd, p, n);
+      if(r < 0)
+      {
+        if(errno == EINTR) continue;
+        return false;
+      }
+      p += r;
+      n -= r;
+    }
+    return true;
+  }
+};
+
+pcap_writer::pcap_writer(const string& path, size_t snaplen_, size_t buffer_size) :
+  snaplen(snaplen_),
+  fill(0),
+  current(0),
+  pending(0),
+  stopping(false),
+  records(0),
+  waits(0)
+{
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) throw runtime_error("Cannot create " + path + ": " + strerror(errno));
+
+  // Every record must fit in a buffer
+  buffer_size = max(buffer_size, record_size + max_headers + size_t(65536));
+  buffers[0].resize(buffer_size);
+  buffers[1].resize(buffer_size);
+
+  // Global header, in host byte order as is customary
+  struct
+  {
+    uint32_t magic;
+    uint16_t version_major, version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs, snaplen, network;
+  } h = { 0xa1b23c4d, 2, 4, 0, 0, uint32_t(snaplen), linktype_ethernet };
+  memcpy(buffers[0].data(), &h, sizeof(h));
+  fill = sizeof(h);
+
+  writer = thread(&pcap_writer::run, this);
+}
+
+pcap_writer::~pcap_writer()
+{
+  try
+  {
+    flush_current();
+  }
+  catch(...)
+  {
+  }
+
+  {
+    unique_lock<std::mutex> lock(mutex);
+    while(pending > 0) written.wait(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+  close(fd);
+}
+
+void pcap_writer::run()
+{
+  unique_lock<std::mutex> lock(mutex);
+
+  for(;;)
+  {
+    while(!stopping && pending == 0) wake.wait(lock);
+    if(pending == 0) return;
+
+    const char *p = buffers[1 - current].data();
+    const size_t n = pending;
+    lock.unlock();
+    const bool ok = write_all(fd, p, n);
+    const int e = errno;
+    lock.lock();
+
+    if(!ok && error.empty()) error = strerror(e);
+    pending = 0;
+    written.notify_one();
+  }
+}
+
+void pcap_writer::flush_current()
+{
+  unique_lock<std::mutex> lock(mutex);
+  if(pending > 0)
+  {
+    waits ++;
+    PROBE2(log_overflow, "pcap", waits);
+    while(pending > 0) written.wait(lock);
+  }
+  if(!error.empty()) throw runtime_error("Cannot write pcap file: " + error);
+  if(fill == 0) return;
+
+  pending = fill;
+  current = 1 - current;
+  fill = 0;
+  lock.unlock();
+  wake.notify_one();
+}
+
+void pcap_writer::write(const struct timespec& ts,
+                        const boost::asio::ip::udp::endpoint& src,
+                        const boost::asio::ip::udp::endpoint& dst,
+                        const char *payload, size_t size)
+{
+  if(buffers[current].size() - fill < record_size + max_headers + size) flush_current();
+
+  char *record = buffers[current].data() + fill;
+  char *p = record + record_size;
+  const bool v6 = src.address().is_v6();
+  const size_t ip_size = v6 ? ipv6_size : ipv4_size,
+               orig = ethernet_size + ip_size + udp_size + size;
+
+  // Ethernet, with null addresses
+  memset(p, 0, 12);
+  put16(p + 12, v6 ? 0x86dd : 0x0800);
+  p += ethernet_size;
+
+  if(v6)
+  {
+    put32(p, 0x60000000);
+    put16(p + 4, udp_size + size);
+    p[6] = 17;
+    p[7] = 64;
+    memcpy(p + 8,  src.address().to_v6().to_bytes().data(), 16);
+    memcpy(p + 24, dst.address().is_v6() ? dst.address().to_v6().to_bytes().data()
+                                         : boost::asio::ip::address_v6().to_bytes().data(), 16);
+  }
+  else
+  {
+    memset(p, 0, ipv4_size);
+    p[0] = 0x45;
+    put16(p + 2, ipv4_size + udp_size + size);
+    p[8] = 64;
+    p[9] = 17;
+    memcpy(p + 12, src.address().to_v4().to_bytes().data(), 4);
+    if(dst.address().is_v4()) memcpy(p + 16, dst.address().to_v4().to_bytes().data(), 4);
+    put16(p + 10, ip_checksum(p, ipv4_size));
+  }
+  p += ip_size;
+
+  // UDP, without checksum
+  put16(p, src.port());
+  put16(p + 2, dst.port());
+  put16(p + 4, udp_size + size);
+  put16(p + 6, 0);
+  p += udp_size;
+
+  const size_t incl = min(orig, snaplen),
+               copied = incl > orig - size ? incl - (orig - size) : 0;
+  memcpy(p, payload, copied);
+
+  const uint32_t h[4] = { uint32_t(ts.tv_sec), uint32_t(ts.tv_nsec), uint32_t(incl), uint32_t(orig) };
+  memcpy(record, h, sizeof(h));
+
+  fill += record_size + incl;
+  records ++;
+}
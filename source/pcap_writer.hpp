@@ -0,0 +1,64 @@
+// pcap_writer.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PCAP_WRITER_HPP_20261019
+#define PCAP_WRITER_HPP_20261019
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <time.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "shorthands.hpp"
+
+/// \brief Write received UDP payloads to a pcap file.
+/// Ethernet, IP and UDP headers are synthesized from the given endpoints.
+/// Records are accumulated in one of two large buffers while a background
+/// thread writes the other one, so that writing does not block reception.
+class pcap_writer
+{
+  int fd;
+  size_t snaplen;
+  std::vector<char> buffers[2];
+  size_t fill;          // Bytes used in the current buffer
+  nat current;          // Index of the buffer being filled
+  size_t pending;       // Bytes of the other buffer to write, 0 if none
+  bool stopping;
+  std::string error;
+  std::mutex mutex;
+  std::condition_variable wake, written;
+  std::thread writer;
+  uint64_t records, waits;
+
+  void run();
+  void flush_current();
+
+public:
+  typedef boost::shared_ptr<pcap_writer> ptr;
+
+  /// \param snaplen     Maximum number of bytes to save per packet, headers included
+  /// \param buffer_size Size of each of the two buffers
+  /// \throws std::runtime_error if the file cannot be created
+  pcap_writer(const std::string& path, size_t snaplen=65535, size_t buffer_size=4 << 20);
+  ~pcap_writer();
+
+  /// Save a UDP datagram received at time ts.
+  /// \throws std::runtime_error if the background writes failed
+  void write(const struct timespec& ts,
+             const boost::asio::ip::udp::endpoint& src,
+             const boost::asio::ip::udp::endpoint& dst,
+             const char *payload, size_t size);
+
+  uint64_t get_records() const { return records; }
+
+  /// Return the number of times writing had to wait for the disk.
+  uint64_t get_waits() const { return waits; }
+};
+
+#endif
@@ -0,0 +1,230 @@
+// perf_counters.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.hpp"
+
+using namespace std;
+
+static const char *names[perf_events] =
+{
+  "cycles", "instructions", "cache_misses", "branch_misses", "context_switches"
+};
+
+perf_sample::perf_sample() : cpu_seconds(0), cpu_valid(false)
+{
+  for(nat e = 0; e < perf_events; e ++)
+  {
+    count[e] = 0;
+    valid[e] = false;
+  }
+}
+
+perf_sample& perf_sample::operator+=(const perf_sample& other)
+{
+  for(nat e = 0; e < perf_events; e ++)
+  {
+    count[e] += other.count[e];
+    valid[e] |= other.valid[e];
+  }
+  cpu_seconds += other.cpu_seconds;
+  cpu_valid |= other.cpu_valid;
+  return *this;
+}
+
+perf_sample perf_sample::operator-(const perf_sample& origin) const
+{
+  perf_sample d(*this);
+  for(nat e = 0; e < perf_events; e ++) d.count[e] -= origin.count[e];
+  d.cpu_seconds -= origin.cpu_seconds;
+  return d;
+}
+
+void perf_sample::write_json(ostream& out, const string& prefix, uint64_t packets, uint64_t bytes) const
+{
+  // Counts per byte are often well below 1
+  const ios::fmtflags flags = out.flags();
+  const streamsize precision = out.precision(6);
+  out.unsetf(ios::floatfield);
+  out << "\"" << prefix << "cpu_ns_per_packet\": ";
+  if(cpu_valid && packets) out << 1e9 * cpu_seconds / packets;
+  else out << "null";
+  for(nat e = 0; e < perf_events; e ++)
+  {
+    out << ", \"" << prefix << names[e] << "_per_packet\": ";
+    if(valid[e] && packets) out << double(count[e]) / packets;
+    else out << "null";
+    out << ", \"" << prefix << names[e] << "_per_byte\": ";
+    if(valid[e] && bytes) out << double(count[e]) / bytes;
+    else out << "null";
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+static int open_event(uint32_t type, uint64_t config, bool exclude_kernel)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static string reason(int e)
+{
+  if(e == EACCES || e == EPERM) return "not permitted";
+  if(e == ENOENT || e == EOPNOTSUPP || e == ENODEV) return "not supported by this CPU or hypervisor";
+  return strerror(e);
+}
+
+static string paranoia()
+{
+  ifstream in("/proc/sys/kernel/perf_event_paranoid");
+  int level;
+  if(!(in >> level)) return "";
+  stringstream u;
+  u << ", kernel.perf_event_paranoid is " << level;
+  return u.str();
+}
+
+static bool read_clock(clockid_t clock, double& seconds)
+{
+  struct timespec ts;
+  if(clock_gettime(clock, &ts)) return false;
+  seconds = ts.tv_sec + 1e-9 * ts.tv_nsec;
+  return true;
+}
+
+// Voluntary and involuntary context switches of the calling thread
+static bool read_switches(uint64_t& n)
+{
+  struct rusage ru;
+  if(getrusage(RUSAGE_THREAD, &ru)) return false;
+  n = ru.ru_nvcsw + ru.ru_nivcsw;
+  return true;
+}
+
+perf_counters::perf_counters() :
+  cpu_origin(0),
+  user_only(false),
+  owner(pthread_self()),
+  rusage_switches(false),
+  switches_origin(0)
+{
+  static const uint32_t types[perf_events] =
+  {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE
+  };
+  static const uint64_t configs[perf_events] =
+  {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_SW_CONTEXT_SWITCHES
+  };
+
+  if(pthread_getcpuclockid(pthread_self(), &cpu_clock)) cpu_clock = CLOCK_THREAD_CPUTIME_ID;
+  read_clock(cpu_clock, cpu_origin);
+
+  bool denied = false;
+  string last_reason;
+  for(nat e = 0; e < perf_events; e ++)
+  {
+    fd[e] = open_event(types[e], configs[e], user_only);
+    if(fd[e] < 0 && (errno == EACCES || errno == EPERM) && !user_only)
+    {
+      // Counting the kernel needs a perf_event_paranoid of 1 or less
+      user_only = true;
+      fd[e] = open_event(types[e], configs[e], user_only);
+    }
+    if(e == perf_context_switches && user_only && read_switches(switches_origin))
+    {
+      if(fd[e] >= 0) close(fd[e]);
+      fd[e] = -1;
+      rusage_switches = true;
+      continue;
+    }
+    if(fd[e] < 0)
+    {
+      // Events failing for the same reason are listed together
+      const string why = reason(errno);
+      denied |= errno == EACCES || errno == EPERM;
+      if(!missing.empty() && why != last_reason) missing += " (" + last_reason + ")";
+      if(!missing.empty()) missing += ", ";
+      missing += names[e];
+      last_reason = why;
+    }
+  }
+  if(!missing.empty()) missing += " (" + last_reason + ")";
+  if(denied) missing += paranoia();
+}
+
+perf_counters::~perf_counters()
+{
+  for(nat e = 0; e < perf_events; e ++) if(fd[e] >= 0) close(fd[e]);
+}
+
+perf_sample perf_counters::sample() const
+{
+  perf_sample s;
+  for(nat e = 0; e < perf_events; e ++)
+  {
+    uint64_t v[3]; // Value, time enabled, time running
+    if(fd[e] < 0 || read(fd[e], v, sizeof(v)) != sizeof(v)) continue;
+    s.count[e] = v[2] > 0 && v[2] < v[1] ? uint64_t(double(v[0]) * v[1] / v[2]) : v[0];
+    s.valid[e] = true;
+  }
+  if(rusage_switches && pthread_equal(pthread_self(), owner) && read_switches(s.count[perf_context_switches]))
+  {
+    s.count[perf_context_switches] -= switches_origin;
+    s.valid[perf_context_switches] = true;
+  }
+  if(read_clock(cpu_clock, s.cpu_seconds))
+  {
+    s.cpu_seconds -= cpu_origin;
+    s.cpu_valid = true;
+  }
+  return s;
+}
+
+void perf_counters::report(ostream& out, const vector<usage>& threads) const
+{
+  out << "Thread usage, " << (user_only ? "user space only" : "user and kernel space")
+      << (rusage_switches ? ", context switches from getrusage" : "") << ":\n  "
+      << left << setw(12) << "Thread" << setw(8) << "Per" << right << setw(12) << "CPU ns";
+  for(nat e = 0; e < perf_events; e ++) out << setw(18) << names[e];
+  for(size_t k = 0; k < threads.size(); k ++)
+  {
+    const usage& u = threads[k];
+    for(nat per_byte = 0; per_byte < 2; per_byte ++)
+    {
+      const uint64_t n = per_byte ? u.bytes : u.packets;
+      out << "\n  " << left << setw(12) << (per_byte ? "" : u.thread) << setw(8) << (per_byte ? "byte" : "packet") << right;
+      if(u.s.cpu_valid && n) out << setw(12) << 1e9 * u.s.cpu_seconds / n;
+      else out << setw(12) << "-";
+      for(nat e = 0; e < perf_events; e ++)
+      {
+        if(u.s.valid[e] && n) out << setw(18) << double(u.s.count[e]) / n;
+        else out << setw(18) << "-";
+      }
+    }
+  }
+  if(!missing.empty()) out << "\n  Not counted: " << missing;
+  out << endl;
+}
@@ -0,0 +1,96 @@
+// perf_counters.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PERF_COUNTERS_HPP_20261019
+#define PERF_COUNTERS_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <pthread.h>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+
+enum perf_event
+{
+  perf_cycles,
+  perf_instructions,
+  perf_cache_misses,
+  perf_branch_misses,
+  perf_context_switches,
+  perf_events
+};
+
+/// \brief Event counts and CPU time of a thread.
+struct perf_sample
+{
+  uint64_t count[perf_events];
+  bool valid[perf_events];   // Whether the event could be counted
+  double cpu_seconds;
+  bool cpu_valid;
+
+  perf_sample();
+
+  /// Add the usage of another thread or another run.
+  perf_sample& operator+=(const perf_sample& other);
+
+  /// Return the usage since an earlier sample of the same counters.
+  perf_sample operator-(const perf_sample& origin) const;
+
+  /// Write the counts per packet and per byte as members of a JSON object,
+  /// prefixed with prefix, with null for events that could not be counted.
+  void write_json(std::ostream& out, const std::string& prefix, uint64_t packets, uint64_t bytes) const;
+};
+
+/// \brief Hardware and software event counters of the calling thread, from
+/// perf_event_open(2), with its CPU time.
+///
+/// Each event is opened on its own, for the thread that constructs the object,
+/// in user and kernel space, or in user space only when perf_event_paranoid
+/// forbids counting the kernel.  Events that cannot be opened, for lack of
+/// privileges or of a PMU as in many virtual machines, are reported as missing
+/// and the others are still counted.  Counts are scaled when the kernel
+/// multiplexes counters.  sample() may be called from any thread as long as
+/// the counted thread runs, since the CPU time is read from its clock.
+///
+/// Context switches happen in the kernel, so that user space only counting
+/// would never see any: they are then taken from getrusage(2), which is only
+/// possible when sample() is called from the counted thread.
+class perf_counters
+{
+  int fd[perf_events];
+  clockid_t cpu_clock;
+  double cpu_origin;
+  bool user_only;
+  pthread_t owner;
+  bool rusage_switches;     // Whether context switches are read with getrusage(2)
+  uint64_t switches_origin;
+  std::string missing; // Events that could not be opened, and why
+
+public:
+  typedef boost::shared_ptr<perf_counters> ptr;
+
+  perf_counters();
+  ~perf_counters();
+
+  /// Return the counts since construction.
+  perf_sample sample() const;
+
+  /// Usage of a thread that processed so many packets and bytes.
+  struct usage
+  {
+    std::string thread;
+    perf_sample s;
+    uint64_t packets, bytes;
+  };
+
+  /// Write a table of the usage of threads, per packet and per byte, with
+  /// the events that these counters could not count.
+  void report(std::ostream& out, const std::vector<usage>& threads) const;
+};
+
+#endif
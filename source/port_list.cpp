@@ -0,0 +1,57 @@
+// port_list.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "port_list.hpp"
+
+using namespace std;
+
+nat parse_port(const string& u)
+{
+  stringstream in(u);
+  nat p = 0;
+  in >> p;
+  if(in.fail() || !in.eof() || p == 0 || p > 65535) throw runtime_error("Bad port " + u);
+  return p;
+}
+
+port_list port_list::parse(const string& u)
+{
+  port_list l;
+  stringstream in(u);
+  string item;
+  while(getline(in, item, ','))
+  {
+    const size_t dash = item.find('-');
+    const nat p0 = parse_port(item.substr(0, dash)),
+              p1 = dash == string::npos ? p0 : parse_port(item.substr(dash + 1));
+    if(p1 < p0) throw runtime_error("Empty port range " + item);
+    for(nat p = p0; p <= p1; p ++) l.ports.push_back(p);
+  }
+  if(l.ports.empty()) throw runtime_error("No ports in " + u);
+
+  vector<nat> sorted(l.ports);
+  sort(sorted.begin(), sorted.end());
+  if(adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) throw runtime_error("Duplicate ports in " + u);
+  return l;
+}
+
+ostream& operator<<(ostream& out, const port_list& self)
+{
+  // Runs of consecutive ports are written as ranges
+  for(size_t i = 0; i < self.ports.size(); )
+  {
+    size_t j = i + 1;
+    while(j < self.ports.size() && self.ports[j] == self.ports[j - 1] + 1) j ++;
+    if(i > 0) out << ",";
+    out << self.ports[i];
+    if(j - i > 1) out << "-" << self.ports[j - 1];
+    i = j;
+  }
+  return out;
+}
@@ -0,0 +1,33 @@
+// port_list.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PORT_LIST_HPP_20261019
+#define PORT_LIST_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shorthands.hpp"
+
+/// UDP ports from --port, a comma-separated list of ports and ranges such as
+/// 33333,40000-40999.
+struct port_list
+{
+  std::vector<nat> ports;
+
+  explicit port_list(nat port=0) { if(port) ports.push_back(port); }
+
+  /// \throws std::runtime_error if the description is invalid
+  static port_list parse(const std::string& u);
+};
+
+std::ostream& operator<<(std::ostream& out, const port_list& self);
+
+/// Parse a single UDP port number.
+/// \throws std::runtime_error unless u is a number from 1 to 65535
+nat parse_port(const std::string& u);
+
+#endif
@@ -0,0 +1,41 @@
+// probes.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef PROBES_HPP_20261019
+#define PROBES_HPP_20261019
+
+// USDT static tracepoints of the udptool provider, for bpftrace, perf or
+// SystemTap; see tools/*.bt.  A probe site is a single nop and its arguments
+// are operands of that nop, so probes left alone cost next to nothing and are
+// compiled into every build where <sys/sdt.h> is found (HAVE_SYS_SDT_H, set
+// by cmake).  Elsewhere, the macros expand to nothing.
+//
+//   transmit(seq, size, t_scheduled, t_sent)      Times in ns since the start of the flood
+//   pacing_overrun(seq, t_scheduled, t_now)       The pacer was called past a deadline
+//   receive(seq, size, status, delay)             Delay in us, with the clock offset between hosts
+//   gap(first, last, count)                       Missing range found by the miss checker
+//   log_overflow(what, count)                     A log ring was full: "flight" or "pcap"
+
+#ifndef HAVE_SYS_SDT_H
+  #define HAVE_SYS_SDT_H 0
+#endif
+
+#if HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PROBE2(name, a, b)       DTRACE_PROBE2(udptool, name, a, b)
+#define PROBE3(name, a, b, c)    DTRACE_PROBE3(udptool, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(udptool, name, a, b, c, d)
+
+#else
+
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#define PROBE4(name, a, b, c, d)
+
+#endif
+
+#endif
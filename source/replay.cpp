@@ -0,0 +1,220 @@
+// replay.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <stdexcept>
+#include <byteswap.h>
+
+#include "replay.hpp"
+
+using namespace std;
+
+namespace
+{
+  enum
+  {
+    pcap_magic_us      = 0xa1b2c3d4,
+    pcap_magic_ns      = 0xa1b23c4d,
+    pcap_header_size   = 24,
+    pcap_record_size   = 16,
+    linktype_null      = 0,
+    linktype_ethernet  = 1,
+    linktype_raw       = 101,
+    linktype_linux_sll = 113,
+    linktype_ipv4      = 228,
+    linktype_ipv6      = 229
+  };
+};
+
+replay_source::replay_source(const string& path, double speed_, size_t max_size_) :
+  file(path),
+  p(file.data()),
+  end(file.data() + file.size()),
+  speed(speed_),
+  max_size(max_size_),
+  swapped(false),
+  nanoseconds(false),
+  have_first(false),
+  link_type(0),
+  t_first(0),
+  t_last(0),
+  packets(0),
+  skipped(0)
+{
+  if(speed <= 0) throw runtime_error("Replay speed must be positive");
+
+  uint32_t magic = 0;
+  if(file.size() >= pcap_header_size)
+  {
+    memcpy(&magic, p, sizeof(magic));
+  }
+
+  if(magic == pcap_magic_us || magic == pcap_magic_ns ||
+     bswap_32(magic) == pcap_magic_us || bswap_32(magic) == pcap_magic_ns)
+  {
+    fmt = pcap;
+    swapped = magic != pcap_magic_us && magic != pcap_magic_ns;
+    nanoseconds = get32(p) == pcap_magic_ns;
+    link_type = get32(p + 20) & 0x0fffffff;
+    p += pcap_header_size;
+
+    switch(link_type)
+    {
+      case linktype_null:
+      case linktype_ethernet:
+      case linktype_raw:
+      case linktype_linux_sll:
+      case linktype_ipv4:
+      case linktype_ipv6:
+        break;
+      default:
+        throw runtime_error("Unsupported pcap link type in " + path);
+    }
+  }
+  else
+  {
+    fmt = txl;
+    // Skip the column header
+    const char *q = static_cast<const char *>(memchr(p, '\n', end - p));
+    if(file.size() < 4 || memcmp(p, "t_tx", 4) != 0 || !q)
+      throw runtime_error(path + " is neither a udptool transmission log nor a pcap file");
+    p = q + 1;
+  }
+}
+
+// Parse a decimal number preceded by blanks, without reading past end
+static bool parse_number(const char *&q, const char *end, uint64_t& x)
+{
+  while(q < end && (*q == ' ' || *q == '\t')) q ++;
+  if(q == end || *q < '0' || *q > '9') return false;
+  x = 0;
+  while(q < end && *q >= '0' && *q <= '9') x = 10 * x + (*(q ++) - '0');
+  return true;
+}
+
+uint32_t replay_source::get32(const char *q) const
+{
+  uint32_t x;
+  memcpy(&x, q, sizeof(x));
+  return swapped ? bswap_32(x) : x;
+}
+
+bool replay_source::next_txl(int64_t& t, uint32_t& size)
+{
+  while(p < end)
+  {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if(!eol) eol = end;
+    const char *line = p;
+    p = eol + 1;
+    if(line == eol || *line == '#') continue;
+
+    uint64_t t_us, s;
+    const char *q = line;
+    if(!parse_number(q, eol, t_us) || !parse_number(q, eol, s)) { skipped ++; continue; }
+
+    t = 1000 * int64_t(t_us);
+    size = s;
+    return true;
+  }
+  return false;
+}
+
+bool replay_source::next_pcap(int64_t& t, uint32_t& size)
+{
+  while(end - p >= pcap_record_size)
+  {
+    const uint32_t ts_sec  = get32(p),
+                   ts_frac = get32(p + 4),
+                   incl    = get32(p + 8);
+    const unsigned char *d = reinterpret_cast<const unsigned char *>(p + pcap_record_size);
+    if(size_t(end - p - pcap_record_size) < incl) break;
+    p += pcap_record_size + incl;
+
+    const unsigned char *e = d + incl;
+    uint16_t ethertype = 0;
+
+    switch(link_type)
+    {
+      case linktype_ethernet:
+        if(e - d < 14) { skipped ++; continue; }
+        ethertype = (d[12] << 8) | d[13];
+        d += 14;
+        while((ethertype == 0x8100 || ethertype == 0x88a8) && e - d >= 4)
+        {
+          ethertype = (d[2] << 8) | d[3];
+          d += 4;
+        }
+        break;
+      case linktype_linux_sll:
+        if(e - d < 16) { skipped ++; continue; }
+        ethertype = (d[14] << 8) | d[15];
+        d += 16;
+        break;
+      case linktype_null:
+        if(e - d < 4) { skipped ++; continue; }
+        d += 4;
+        // Fall through, the IP version tells
+      default:
+        if(e - d < 1) { skipped ++; continue; }
+        ethertype = (d[0] >> 4) == 6 ? 0x86dd : 0x0800;
+        break;
+    }
+
+    const unsigned char *udp = NULL;
+    if(ethertype == 0x0800 && e - d >= 20 && (d[0] >> 4) == 4 && d[9] == 17)
+    {
+      udp = d + 4 * (d[0] & 15);
+    }
+    else if(ethertype == 0x86dd && e - d >= 40 && (d[0] >> 4) == 6 && d[6] == 17)
+    {
+      udp = d + 40;
+    }
+
+    // The UDP length field gives the size even if the capture was truncated
+    if(!udp || e - udp < 8) { skipped ++; continue; }
+    const uint16_t udp_length = (udp[4] << 8) | udp[5];
+    if(udp_length < 8) { skipped ++; continue; }
+
+    t = 1000000000 * int64_t(ts_sec) + (nanoseconds ? 1 : 1000) * int64_t(ts_frac);
+    size = udp_length - 8;
+    return true;
+  }
+  return false;
+}
+
+size_t replay_source::fill(schedule_entry *entries, size_t n)
+{
+  size_t i = 0;
+  int64_t t;
+  uint32_t size;
+
+  while(i < n && (fmt == txl ? next_txl(t, size) : next_pcap(t, size)))
+  {
+    if(!have_first)
+    {
+      t_first = t;
+      have_first = true;
+    }
+    entries[i].t = int64_t((t - t_first) / speed);
+    entries[i].size = size < max_size ? size : max_size;
+    entries[i].pad = 0;
+    // Traces are not necessarily sorted
+    if(entries[i].t < t_last) entries[i].t = t_last;
+    t_last = entries[i].t;
+    i ++;
+    packets ++;
+  }
+
+  return i;
+}
+
+ostream& operator<<(ostream& out, const replay_source& self)
+{
+  out << "Replaying " << (self.fmt == replay_source::pcap ? "pcap capture" : "transmission log")
+      << " of " << self.file.size() << " bytes at speed " << self.speed;
+  if(self.packets > 0 || self.skipped > 0)
+    out << ", " << self.packets << " packets read, " << self.skipped << " records skipped";
+  return out;
+}
@@ -0,0 +1,50 @@
+// replay.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef REPLAY_HPP_20261019
+#define REPLAY_HPP_20261019
+
+#include <iostream>
+#include <string>
+
+#include "shorthands.hpp"
+#include "mapped_file.hpp"
+#include "schedule.hpp"
+
+/// \brief Replay the sizes and send times of a trace.
+/// The trace is either a udptool transmission log (.txl) or a pcap capture,
+/// from which the UDP payload sizes of IPv4 and IPv6 UDP packets are taken.
+/// The file is memory-mapped and decoded incrementally by the schedule
+/// generator.
+class replay_source : public schedule_source
+{
+  enum format { txl, pcap };
+
+  mapped_file file;
+  format fmt;
+  const char *p, *end;
+  double speed;
+  size_t max_size;
+  bool swapped, nanoseconds, have_first;
+  uint32_t link_type;
+  int64_t t_first, t_last;
+  uint64_t packets, skipped;
+
+  bool next_txl(int64_t& t, uint32_t& size);
+  bool next_pcap(int64_t& t, uint32_t& size);
+  uint32_t get32(const char *q) const;
+
+public:
+  /// \param speed    Divide the inter-packet gaps by this factor
+  /// \param max_size Clip packet sizes to this size
+  /// \throws std::runtime_error if the file cannot be read or its format is not recognized
+  replay_source(const std::string& path, double speed, size_t max_size);
+
+  size_t fill(schedule_entry *entries, size_t n);
+
+  friend std::ostream& operator<<(std::ostream& out, const replay_source& self);
+};
+
+#endif
@@ -0,0 +1,95 @@
+// rng.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef RNG_HPP_20261019
+#define RNG_HPP_20261019
+
+#include <cmath>
+
+#include "shorthands.hpp"
+
+/// \brief Fast seedable pseudo-random number generator (xoshiro256**).
+/// Not thread-safe; every thread drawing random numbers owns its generator,
+/// derived from the global seed and a stream number so that runs are
+/// reproducible.
+class fast_rng
+{
+  uint64_t s[4];
+  bool have_spare;
+  double spare;
+
+  static inline uint64_t rol64(uint64_t x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  static uint64_t splitmix64(uint64_t& x)
+  {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+public:
+  /// \param seed   Global seed
+  /// \param stream Stream number, distinct for every generator sharing a seed
+  explicit fast_rng(uint64_t seed=0, uint64_t stream=0) : have_spare(false), spare(0)
+  {
+    uint64_t x = seed ^ splitmix64(stream);
+    for(nat i = 0; i < 4; i ++) s[i] = splitmix64(x);
+  }
+
+  uint64_t get()
+  {
+    const uint64_t result = rol64(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rol64(s[3], 45);
+    return result;
+  }
+
+  /// Return a uniform double in [0, 1).
+  double uniform()
+  {
+    return (get() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  /// Return a uniform integer in [0, n).
+  uint64_t below(uint64_t n)
+  {
+    return uint64_t((unsigned __int128) get() * n >> 64);
+  }
+
+  /// Return a standard normal deviate (Marsaglia polar method).
+  double normal()
+  {
+    if(have_spare)
+    {
+      have_spare = false;
+      return spare;
+    }
+
+    double u, v, r;
+    do
+    {
+      u = 2 * uniform() - 1;
+      v = 2 * uniform() - 1;
+      r = u * u + v * v;
+    }
+    while(r >= 1 || r == 0);
+
+    const double f = sqrt(-2 * log(r) / r);
+    spare = v * f;
+    have_spare = true;
+    return u * f;
+  }
+};
+
+#endif
@@ -0,0 +1,72 @@
+// rx_status.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef RX_STATUS_HPP_20261019
+#define RX_STATUS_HPP_20261019
+
+#include <string>
+
+#include "shorthands.hpp"
+
+/// Reception status of a packet, as a bitmask.  The bits up to rx_ber have the
+/// same values as those of curx_status in curx.h.
+enum rx_status
+{
+  rx_ok    = 0,
+  rx_short = 1,
+  rx_bad   = 2,
+  rx_ooo   = 4,
+  rx_dup   = 8,
+  rx_trunc = 16,
+  rx_ber   = 32,
+  rx_crc   = 64, // CRC32C mismatch, with --integrity crc32c
+  rx_status_max = 127,
+  rx_damaged = rx_short | rx_bad | rx_trunc | rx_ber | rx_crc // Packets whose contents are damaged
+};
+
+/// Return the name of a status bitmask as written in the reception log: "ok"
+/// if no bit is set, otherwise the names of the set bits separated by dashes,
+/// e.g. "ooo-dup".
+inline const char *rx_status_name(nat status)
+{
+  static const char *names[] = { "short", "bad", "ooo", "dup", "trunc", "ber", "crc" };
+
+  struct table
+  {
+    std::string entries[rx_status_max + 1];
+
+    table()
+    {
+      entries[0] = "ok";
+      for(nat s = 1; s <= rx_status_max; s ++)
+      {
+        for(nat i = 0; i < sizeof(names)/sizeof(*names); i ++)
+        {
+          if(s & (1 << i))
+          {
+            if(!entries[s].empty()) entries[s] += "-";
+            entries[s] += names[i];
+          }
+        }
+      }
+    }
+  };
+
+  static const table t;
+  return t.entries[status & rx_status_max].c_str();
+}
+
+/// Parse a status name as written by rx_status_name().
+/// \returns The status bitmask, or -1 if the name is not recognized
+inline int rx_status_parse(const std::string& u)
+{
+  for(nat s = 0; s <= rx_status_max; s ++)
+  {
+    if(u == rx_status_name(s)) return s;
+  }
+  return -1;
+}
+
+#endif
@@ -0,0 +1,237 @@
+// scenario.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "scenario.hpp"
+
+using namespace std;
+
+void scenario::parse_phase(phase& p, istream& in)
+{
+  string kv;
+
+  while(in >> kv)
+  {
+    size_t i = kv.find('=');
+    if(i == string::npos) throw runtime_error("Expected key=value, got " + kv);
+    const string key = kv.substr(0, i), value = kv.substr(i + 1);
+    stringstream v(value);
+
+    if(key == "duration")   v >> p.duration;
+    else if(key == "count") v >> p.count;
+    else if(key == "burst") v >> p.burst;
+    else if(key == "size")
+    {
+      p.size = distribution::parse(value);
+      continue;
+    }
+    else if(key == "gap")
+    {
+      p.gap = distribution::parse(value);
+      continue;
+    }
+    else if(key == "rate")
+    {
+      size_t j = value.find("..");
+      if(j == string::npos)
+      {
+        v >> p.rate0;
+        p.rate1 = p.rate0;
+      }
+      else
+      {
+        v.str(value.substr(0, j));
+        v >> p.rate0;
+        if(v.fail()) throw runtime_error("Bad rate " + value);
+        v.clear();
+        v.str(value.substr(j + 2));
+        v >> p.rate1;
+      }
+    }
+    else throw runtime_error("Unknown phase key " + key);
+
+    if(v.fail() || !v.eof()) throw runtime_error("Bad value for " + key);
+  }
+
+  if(!p.size) p.size = distribution::ptr(new dirac(1472));
+  if(p.burst == 0) throw runtime_error("Burst length must be positive");
+  if(p.duration < 0) throw runtime_error("Negative duration");
+  if(p.gap && p.rate0 > 0) throw runtime_error("Specify either rate or gap, not both");
+  if(!p.gap && (p.rate0 <= 0 || p.rate1 <= 0)) throw runtime_error("Phase needs a positive rate or a gap");
+  if(p.rate0 != p.rate1 && p.duration == 0 && p.count == 0)
+    throw runtime_error("A rate ramp needs a duration or a count");
+}
+
+scenario::scenario(const string& file, size_t max_size_, const fast_rng& g_) :
+  repeat(1),
+  max_size(max_size_),
+  g(g_),
+  index(0),
+  round(0),
+  t(0),
+  phase_start(0),
+  k(0),
+  round_packets(0),
+  in_burst(0),
+  sizes_i(batch),
+  gaps_i(batch)
+{
+  ifstream in(file.c_str());
+  if(!in) throw runtime_error("Cannot open scenario file " + file);
+
+  string line;
+  nat line_number = 0;
+
+  while(getline(in, line))
+  {
+    line_number ++;
+    size_t i = line.find('#');
+    if(i != string::npos) line.erase(i);
+    stringstream ls(line);
+    string keyword;
+    if(!(ls >> keyword)) continue;
+
+    try
+    {
+      if(keyword == "phase")
+      {
+        phase p;
+        parse_phase(p, ls);
+        phases.push_back(p);
+      }
+      else if(keyword == "pause")
+      {
+        phase p;
+        p.idle = true;
+        ls >> p.duration;
+        if(ls.fail() || p.duration < 0) throw runtime_error("Bad pause duration");
+        phases.push_back(p);
+      }
+      else if(keyword == "repeat")
+      {
+        ls >> repeat;
+        if(ls.fail()) throw runtime_error("Bad repeat count");
+      }
+      else throw runtime_error("Unknown keyword " + keyword);
+
+      if(!(ls >> ws).eof()) throw runtime_error("Trailing garbage");
+    }
+    catch(runtime_error& e)
+    {
+      stringstream u;
+      u << file << ":" << line_number << ": " << e.what();
+      throw runtime_error(u.str());
+    }
+  }
+
+  if(phases.empty()) throw runtime_error("Scenario " + file + " has no phases");
+}
+
+void scenario::next_phase()
+{
+  const phase& p = phases[index];
+  if(p.idle) t = phase_start + 1e9 * p.duration;
+  index ++;
+  phase_start = t;
+  k = 0;
+  in_burst = 0;
+  sizes_i = batch;
+  gaps_i = batch;
+}
+
+size_t scenario::fill(schedule_entry *entries, size_t n)
+{
+  size_t i = 0;
+
+  while(i < n)
+  {
+    if(index == phases.size())
+    {
+      round ++;
+      // Stop if the scenario is finished, or if a whole round produced no packets
+      if((repeat > 0 && round >= repeat) || round_packets == 0) break;
+      index = 0;
+      round_packets = 0;
+    }
+
+    const phase& p = phases[index];
+    const double elapsed = t - phase_start;
+
+    if(p.idle ||
+       (p.duration > 0 && elapsed >= 1e9 * p.duration) ||
+       (p.count > 0 && k >= p.count))
+    {
+      next_phase();
+      continue;
+    }
+
+    if(sizes_i == batch)
+    {
+      p.size->fill(g, sizes, batch);
+      sizes_i = 0;
+    }
+    const double size = sizes[sizes_i ++];
+    entries[i].t = int64_t(t);
+    entries[i].size = size > 0 ? (size < max_size ? uint32_t(size) : max_size) : 0;
+    entries[i].pad = 0;
+    i ++;
+    k ++;
+    round_packets ++;
+
+    if(++ in_burst == p.burst)
+    {
+      in_burst = 0;
+      if(p.gap)
+      {
+        if(gaps_i == batch)
+        {
+          p.gap->fill(g, gaps, batch);
+          gaps_i = 0;
+        }
+        const double gap = gaps[gaps_i ++];
+        if(gap > 0) t += 1e6 * gap;
+      }
+      else
+      {
+        double f = 0;
+        if(p.duration > 0)   f = elapsed / (1e9 * p.duration);
+        else if(p.count > 0) f = double(k) / p.count;
+        const double rate = p.rate0 + (p.rate1 - p.rate0) * f;
+        t += 1e9 * p.burst / rate;
+      }
+    }
+  }
+
+  return i;
+}
+
+ostream& operator<<(ostream& out, const scenario& self)
+{
+  out << "Scenario with " << self.phases.size() << " phases, ";
+  if(self.repeat == 0) out << "repeated for ever";
+  else out << "played " << self.repeat << " times";
+
+  for(size_t i = 0; i < self.phases.size(); i ++)
+  {
+    const scenario::phase& p = self.phases[i];
+    out << "\n  " << i + 1 << ": ";
+    if(p.idle)
+    {
+      out << "pause " << p.duration << " s";
+      continue;
+    }
+    if(p.duration > 0) out << p.duration << " s ";
+    if(p.count > 0) out << p.count << " pk ";
+    out << "size mean " << p.size->mean() << " B, ";
+    if(p.gap) out << "gap mean " << p.gap->mean() << " ms";
+    else if(p.rate0 == p.rate1) out << p.rate0 << " pk/s";
+    else out << p.rate0 << " to " << p.rate1 << " pk/s";
+    if(p.burst > 1) out << " in bursts of " << p.burst;
+  }
+  return out;
+}
@@ -0,0 +1,81 @@
+// scenario.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef SCENARIO_HPP_20261019
+#define SCENARIO_HPP_20261019
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shorthands.hpp"
+#include "distribution.hpp"
+#include "schedule.hpp"
+
+/// \brief Multi-phase traffic scenario read from a file.
+///
+/// Each non-empty line of the file, except comments starting with #, is one of
+///
+///   phase key=value...   Transmit packets
+///   pause S              Stay silent for S seconds
+///   repeat N             Play the whole scenario N times (0 for ever)
+///
+/// with the following phase keys:
+///
+///   duration=S           End the phase after S seconds
+///   count=N              End the phase after N packets
+///   size=D               Packet size distribution in bytes (default 1472)
+///   rate=R or R0..R1     Packet rate in packets/s, or a linear ramp
+///   gap=D                Delay distribution between bursts in ms, instead of rate
+///   burst=K              Send K packets back-to-back at a time (default 1)
+///
+/// where distributions are written as for --size and --delay.
+class scenario : public schedule_source
+{
+  struct phase
+  {
+    bool idle;
+    double duration;
+    uint64_t count;
+    distribution::ptr size;
+    double rate0, rate1;
+    distribution::ptr gap;
+    nat burst;
+
+    phase() : idle(false), duration(0), count(0), rate0(0), rate1(0), burst(1) { }
+  };
+
+  std::vector<phase> phases;
+  nat repeat;
+  size_t max_size;
+  fast_rng g;
+
+  // Generation state
+  size_t index;
+  nat round;
+  double t, phase_start;
+  uint64_t k, round_packets;
+  nat in_burst;
+
+  // Samples are drawn in batches for the current phase
+  enum { batch = 256 };
+  double sizes[batch], gaps[batch];
+  size_t sizes_i, gaps_i;
+
+  void parse_phase(phase& p, std::istream& in);
+  void next_phase();
+
+public:
+  /// \param max_size Sizes are clipped to this many bytes
+  /// \param g        Generator owned by the scenario
+  /// \throws std::runtime_error if the file cannot be read or is invalid
+  scenario(const std::string& file, size_t max_size, const fast_rng& g);
+
+  size_t fill(schedule_entry *entries, size_t n);
+
+  friend std::ostream& operator<<(std::ostream& out, const scenario& self);
+};
+
+#endif
@@ -0,0 +1,218 @@
+// schedule.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <stdexcept>
+
+#include "schedule.hpp"
+
+using namespace std;
+
+namespace
+{
+  enum
+  {
+    // Consecutive packets smaller than one byte after which the size distributions are deemed degenerate
+    max_skipped = 1 << 20
+  };
+}
+
+cyclic_source::cyclic_source(const vector<distribution::ptr>& sizes_, const vector<distribution::ptr>& delays_,
+                             double bandwidth_, size_t default_size_, double default_delay_, size_t max_size_,
+                             const fast_rng& g_) :
+  sizes(sizes_),
+  delays(delays_),
+  bandwidth(bandwidth_),
+  default_size(default_size_),
+  default_delay(default_delay_),
+  max_size(max_size_),
+  t(0),
+  g(g_)
+{
+  d_it = delays.begin();
+  s_it = sizes.begin();
+  have_delays = d_it != delays.end();
+  have_sizes  = s_it != sizes.end();
+
+  if(!have_delays && !have_sizes && bandwidth == 0)
+    throw runtime_error("No delay, size nor bandwidth specified");
+
+  if((!have_delays || !have_sizes) && bandwidth == 0)
+    throw runtime_error("No bandwidth speicifed");
+
+  if(bandwidth > 0 && have_delays && have_sizes)
+    throw runtime_error("You cannot specify all three of bandwidth, delays and sizes.");
+
+  // Sizes derived from the mean delays are fixed, so a schedule which can only skip packets is known now
+  if(have_delays && !have_sizes)
+  {
+    bool positive = false;
+    for(vector<distribution::ptr>::iterator it = delays.begin(); it != delays.end(); it ++)
+      if((*it)->mean() * 1e-3 * (1e6/8.0 * bandwidth) >= 1) positive = true;
+    if(!positive)
+      throw runtime_error("The bandwidth and delays give packets of less than one byte");
+  }
+}
+
+size_t cyclic_source::fill(schedule_entry *entries, size_t n)
+{
+  size_t i = 0, skipped = 0;
+
+  while(i < n)
+  {
+    double delay, delay_avg, size, size_avg;
+
+    if(have_delays)
+    {
+      delay = (*d_it)->next(g);
+      delay_avg = (*d_it)->mean();
+      d_it ++;
+      if(d_it == delays.end()) d_it = delays.begin();
+    }
+    else
+    {
+      delay_avg = delay = default_delay;
+    }
+
+    if(have_sizes)
+    {
+      size = (*s_it)->next(g);
+      size_avg = (*s_it)->mean();
+      s_it ++;
+      if(s_it == sizes.end()) s_it = sizes.begin();
+    }
+    else
+    {
+      size_avg = size = default_size;
+    }
+
+    if(!have_delays)
+    {
+      delay = 1e3 * size_avg / (1e6/8.0 * bandwidth);
+    }
+    else
+    {
+      if(!have_sizes)
+      {
+        size = delay_avg * 1e-3 * (1e6/8.0 * bandwidth);
+      }
+    }
+
+    // Also rejects NaN, before the conversion to an unsigned size
+    if(!(size >= 1))
+    {
+      if(++ skipped == max_skipped)
+        throw runtime_error("The size distributions give no packets of at least one byte");
+      continue;
+    }
+    skipped = 0;
+
+    entries[i].t = int64_t(t);
+    entries[i].size = size < max_size ? uint32_t(size) : max_size;
+    entries[i].pad = 0;
+    i ++;
+
+    if(delay > 0) t += 1e6 * delay;
+  }
+
+  return i;
+}
+
+schedule::schedule(schedule_source::ptr source_, size_t chunk_size, size_t num_chunks) :
+  source(source_),
+  chunks(num_chunks),
+  produced(0),
+  consumed(0),
+  finished(false),
+  stopping(false),
+  cur(NULL),
+  end(NULL),
+  holding(false),
+  stalls(0)
+{
+  for(size_t i = 0; i < num_chunks; i ++)
+  {
+    chunks[i].entries.resize(chunk_size);
+    chunks[i].n = 0;
+  }
+  generator = thread(&schedule::generate, this);
+}
+
+schedule::~schedule()
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  not_full.notify_one();
+  generator.join();
+}
+
+void schedule::generate()
+{
+  try
+  {
+    for(;;)
+    {
+      size_t index;
+      {
+        unique_lock<std::mutex> lock(mutex);
+        while(!stopping && produced - consumed == chunks.size()) not_full.wait(lock);
+        if(stopping) return;
+        index = produced % chunks.size();
+      }
+
+      // The chunk is not visible to the transmitter until produced is incremented
+      chunk& c = chunks[index];
+      c.n = source->fill(c.entries.data(), c.entries.size());
+
+      {
+        lock_guard<std::mutex> lock(mutex);
+        if(c.n > 0) produced ++;
+        if(c.n < c.entries.size()) finished = true;
+      }
+      not_empty.notify_one();
+      if(c.n < c.entries.size()) return;
+    }
+  }
+  catch(...)
+  {
+    {
+      lock_guard<std::mutex> lock(mutex);
+      error = current_exception();
+      finished = true;
+    }
+    not_empty.notify_one();
+  }
+}
+
+bool schedule::refill()
+{
+  unique_lock<std::mutex> lock(mutex);
+
+  if(holding)
+  {
+    consumed ++;
+    holding = false;
+    not_full.notify_one();
+  }
+
+  if(produced == consumed && !finished)
+  {
+    if(consumed > 0) stalls ++;
+    while(produced == consumed && !finished) not_empty.wait(lock);
+  }
+
+  if(produced == consumed)
+  {
+    if(error) rethrow_exception(error);
+    return false;
+  }
+
+  const chunk& c = chunks[consumed % chunks.size()];
+  cur = c.entries.data();
+  end = cur + c.n;
+  holding = true;
+  return true;
+}
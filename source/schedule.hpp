@@ -0,0 +1,114 @@
+// schedule.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef SCHEDULE_HPP_20261019
+#define SCHEDULE_HPP_20261019
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <boost/shared_ptr.hpp>
+
+#include "shorthands.hpp"
+#include "distribution.hpp"
+
+/// One packet to transmit.
+struct schedule_entry
+{
+  int64_t t;     // Send time in nanoseconds since the start of transmission
+  uint32_t size; // UDP payload size in bytes
+  uint32_t pad;
+};
+
+/// \brief Source of schedule entries, run ahead of time in the generator thread.
+class schedule_source
+{
+public:
+  typedef boost::shared_ptr<schedule_source> ptr;
+  virtual ~schedule_source() { }
+
+  /// Fill up to n entries, in increasing send time order.
+  /// \returns The number of entries filled, less than n only at the end of the schedule
+  virtual size_t fill(schedule_entry *entries, size_t n) = 0;
+};
+
+/// \brief The traditional traffic shape, cycling independently through a
+/// list of size distributions and a list of delay distributions, one of
+/// which may be adjusted to obtain a given bandwidth.
+class cyclic_source : public schedule_source
+{
+  std::vector<distribution::ptr> sizes, delays;
+  std::vector<distribution::ptr>::iterator d_it, s_it;
+  bool have_delays, have_sizes;
+  double bandwidth;
+  size_t default_size;
+  double default_delay;
+  size_t max_size;
+  double t;
+  fast_rng g;
+
+public:
+  /// \param bandwidth     Bandwidth in Mbit/s, or 0
+  /// \param default_size  Size used when no size distribution is given, in bytes
+  /// \param default_delay Delay used when no delay distribution is given, in ms
+  /// \param max_size      Sizes are clipped to this many bytes
+  /// \param g             Generator owned by the source
+  /// \throws std::runtime_error if the parameters are inconsistent or give no packets
+  cyclic_source(const std::vector<distribution::ptr>& sizes, const std::vector<distribution::ptr>& delays,
+                double bandwidth, size_t default_size, double default_delay, size_t max_size, const fast_rng& g);
+
+  size_t fill(schedule_entry *entries, size_t n);
+};
+
+/// \brief Precompiled transmission schedule.
+/// The schedule is a ring of chunks of entries which a generator thread fills
+/// ahead of the transmitter, so that sampling distributions never delays
+/// sending.
+class schedule
+{
+  struct chunk
+  {
+    std::vector<schedule_entry> entries;
+    size_t n;
+  };
+
+  schedule_source::ptr source;
+  std::vector<chunk> chunks;
+  size_t produced, consumed; // Chunk counts, protected by the mutex
+  bool finished, stopping;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full;
+  std::thread generator;
+
+  const schedule_entry *cur, *end;
+  bool holding;
+  uint64_t stalls;
+
+  void generate();
+  bool refill();
+
+public:
+  /// \param chunk_size Number of entries per chunk
+  /// \param num_chunks Number of chunks in the ring
+  schedule(schedule_source::ptr source, size_t chunk_size=4096, size_t num_chunks=8);
+  ~schedule();
+
+  /// Get the next entry.
+  /// \returns False at the end of the schedule
+  bool next(schedule_entry& e)
+  {
+    if(cur == end && !refill()) return false;
+    e = *(cur ++);
+    return true;
+  }
+
+  /// Return the number of times the transmitter had to wait for the generator.
+  uint64_t get_stalls() const { return stalls; }
+};
+
+#endif
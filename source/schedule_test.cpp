@@ -0,0 +1,77 @@
+// schedule_test
+//
+// Check that schedule sources never produce packets larger than the send
+// buffers, whatever the sizes asked for.
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstdio>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include "shorthands.hpp"
+#include "distribution.hpp"
+#include "schedule.hpp"
+#include "scenario.hpp"
+
+using namespace std;
+
+enum
+{
+  max_size = 65507,
+  entries  = 4096
+};
+
+static nat failures = 0;
+
+// Fill a chunk of entries from the source and check their sizes
+static void check(const string& name, schedule_source& source)
+{
+  vector<schedule_entry> e(entries);
+  const size_t n = source.fill(e.data(), e.size());
+  uint32_t largest = 0;
+  for(size_t i = 0; i < n; i ++) largest = max(largest, e[i].size);
+
+  cout << name << ": " << n << " packets, largest " << largest << " bytes" << endl;
+  if(n == 0 || largest > max_size) failures ++;
+}
+
+int main(int argc, char *argv[])
+{
+  {
+    char path[] = "/tmp/schedule_test-XXXXXX";
+    const int fd = mkstemp(path);
+    if(fd < 0)
+    {
+      perror("mkstemp");
+      return 1;
+    }
+    close(fd);
+    {
+      ofstream out(path);
+      out << "phase count=5 size=70000 rate=100\n"
+             "phase count=5 size=5e9 rate=100\n"
+             "phase count=1000 size=pareto:10000,1 rate=100\n";
+    }
+    scenario sc(path, max_size, fast_rng(1, 1));
+    unlink(path);
+    check("scenario", sc);
+  }
+
+  {
+    vector<distribution::ptr> sizes(1, distribution::parse("lognormal:12,2")), delays(1, distribution::parse("1"));
+    cyclic_source source(sizes, delays, 0, 1472, 1, max_size, fast_rng(2, 1));
+    check("cyclic", source);
+  }
+
+  if(failures > 0)
+  {
+    cout << failures << " sources produce oversize packets" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+// stage_timer.cpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include "stage_timer.hpp"
+
+#if UDPTOOL_STAGE_TIMERS
+
+#include <iomanip>
+
+using namespace std;
+
+thread_local stage_accounting stage_cycles;
+
+ostream& operator<<(ostream& out, const stage_accounting& self)
+{
+  static const char *names[stages] =
+  {
+    "rx dispatch", "rx dequeue", "rx statistic", "rx parse", "rx miss", "rx verify", "rx log", "rx capture",
+    "tx schedule", "tx encode", "tx log", "tx impair", "tx send", "tx statistic"
+  };
+
+#if defined(__x86_64__) || defined(__i386__)
+  const char *unit = "cycles";
+#else
+  const char *unit = "ns";
+#endif
+
+  out << "Stage " << unit << " over " << self.packets << " pk:\n"
+         "  Stage                Events        Mean         p50         p99    Per packet";
+  double total = 0;
+  for(nat s = 0; s < stages; s ++)
+  {
+    const histogram& h = self.h[s];
+    if(!h.count()) continue;
+    const double per_packet = self.packets ? h.mean() * h.count() / self.packets : 0;
+    total += per_packet;
+    out << "\n  " << left << setw(14) << names[s] << right
+        << setw(12) << h.count() << setw(12) << fixed << setprecision(1) << h.mean()
+        << setw(12) << h.quantile(0.5) << setw(12) << h.quantile(0.99) << setw(14) << per_packet;
+  }
+  out << "\n  " << left << setw(14) << "total" << right << setw(62) << total;
+  out.unsetf(ios::floatfield);
+  out << setprecision(6);
+  return out;
+}
+
+#endif
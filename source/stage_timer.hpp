@@ -0,0 +1,102 @@
+// stage_timer.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef STAGE_TIMER_HPP_20261019
+#define STAGE_TIMER_HPP_20261019
+
+// Per-stage cycle accounting of the packet paths, compiled in with the
+// UDPTOOL_STAGE_TIMERS cmake option.  Stages are bracketed with
+// STAGE_START(name) and STAGE_STOP(name) in the same scope; each stage is a
+// histogram of the cycles it took, and the breakdown divides the total cycles
+// of each stage by the packets counted with STAGE_PACKET().  Accounting is per
+// thread.  When the option is off, the macros expand to nothing.
+
+#ifndef UDPTOOL_STAGE_TIMERS
+  #define UDPTOOL_STAGE_TIMERS 0
+#endif
+
+#if UDPTOOL_STAGE_TIMERS
+
+#include <iostream>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#else
+  #include <time.h>
+#endif
+
+#include "shorthands.hpp"
+#include "histogram.hpp"
+
+enum stage
+{
+  stage_rx_dispatch,  // Event loop, between wakeups that left packets in the socket
+  stage_rx_dequeue,   // recvmsg()
+  stage_rx_statistic, // link_statistic
+  stage_rx_parse,     // Header decoding and checksum
+  stage_rx_miss,      // miss_checker
+  stage_rx_verify,    // Payload pattern or CRC
+  stage_rx_log,       // Packet log
+  stage_rx_capture,   // pcap
+  stage_tx_schedule,  // Next schedule entry
+  stage_tx_encode,    // Header and payload
+  stage_tx_log,       // Packet log
+  stage_tx_impair,    // Impairment stage
+  stage_tx_send,      // sendmmsg()
+  stage_tx_statistic, // link_statistic
+  stages
+};
+
+/// Read the cycle counter, or a nanosecond clock where there is none.
+inline uint64_t stage_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000 * uint64_t(ts.tv_sec) + ts.tv_nsec;
+#endif
+}
+
+class stage_accounting
+{
+  histogram h[stages];
+  uint64_t packets;
+
+public:
+  stage_accounting() : packets(0) { }
+
+  void add(stage s, uint64_t cycles) { h[s].add(cycles); }
+  void count_packet() { packets ++; }
+
+  /// Add the accounting of another thread.
+  void merge(const stage_accounting& other)
+  {
+    for(nat s = 0; s < stages; s ++) h[s].merge(other.h[s]);
+    packets += other.packets;
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const stage_accounting& self);
+};
+
+/// Accounting of the calling thread.  Helper threads hand theirs over to the
+/// thread that reports, which merges them.
+extern thread_local stage_accounting stage_cycles;
+
+#define STAGE_START(name) const uint64_t stage_start_##name = stage_clock()
+#define STAGE_STOP(name)  stage_cycles.add(stage_##name, stage_clock() - stage_start_##name)
+#define STAGE_PACKET()    stage_cycles.count_packet()
+#define STAGE_REPORT(out) (out) << stage_cycles << std::endl
+
+#else
+
+#define STAGE_START(name)
+#define STAGE_STOP(name)
+#define STAGE_PACKET()
+#define STAGE_REPORT(out)
+
+#endif
+
+#endif
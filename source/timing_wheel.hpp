@@ -0,0 +1,162 @@
+// timing_wheel.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef TIMING_WHEEL_HPP_20261019
+#define TIMING_WHEEL_HPP_20261019
+
+#include <vector>
+#include <cstring>
+
+#include "shorthands.hpp"
+
+/// \brief Hierarchical timing wheel of integer identifiers.
+/// Four levels of 256 slots cover 2^32 ticks.  An identifier is in at most
+/// one slot, kept in intrusive singly linked lists indexed by identifier, so
+/// that memory is fixed by the capacity.  Scheduling is O(1), and expiring is
+/// O(1) per identifier plus the cascading of higher levels, which moves each
+/// identifier at most three times.  Occupancy bitmaps let the wheel skip over
+/// empty slots.
+class timing_wheel
+{
+  enum
+  {
+    levels    = 4,
+    slot_bits = 8,
+    slots     = 1 << slot_bits,
+    slot_mask = slots - 1,
+    words     = slots / 64
+  };
+
+  enum : uint32_t { none = 0xffffffff }; // End of slot lists
+
+  int64_t tick_ns;
+  uint64_t now;                          // Current tick, all earlier ticks are expired
+  std::vector<uint64_t> expiry;          // Expiry tick of each identifier
+  std::vector<uint32_t> next;            // Next identifier in the same slot
+  uint32_t head[levels][slots];
+  uint64_t occupied[levels][words];
+  size_t size_;
+
+  void insert(uint32_t id)
+  {
+    const uint64_t e = expiry[id], delta = e - now;
+    nat level = 0;
+    while(level < levels - 1 && delta >= (uint64_t(1) << (slot_bits * (level + 1)))) level ++;
+    const nat slot = (e >> (slot_bits * level)) & slot_mask;
+    next[id] = head[level][slot];
+    head[level][slot] = id;
+    occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+  }
+
+  uint32_t take(nat level, nat slot)
+  {
+    const uint32_t id = head[level][slot];
+    head[level][slot] = none;
+    occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    return id;
+  }
+
+  // Redistribute the entries of a slot of a higher level at a period boundary
+  void cascade(nat level)
+  {
+    uint32_t id = take(level, (now >> (slot_bits * level)) & slot_mask);
+    while(id != none)
+    {
+      const uint32_t following = next[id];
+      insert(id);
+      id = following;
+    }
+  }
+
+  // First occupied level 0 slot at or after the given one, or slots
+  nat find_level0(nat slot) const
+  {
+    for(nat w = slot / 64; w < words; w ++)
+    {
+      uint64_t bits = occupied[0][w];
+      if(w == slot / 64) bits &= ~uint64_t(0) << (slot % 64);
+      if(bits) return 64 * w + __builtin_ctzll(bits);
+    }
+    return slots;
+  }
+
+public:
+  /// \param capacity Identifiers are in [0, capacity)
+  /// \param tick_ns_ Resolution of the wheel in nanoseconds
+  timing_wheel(size_t capacity, int64_t tick_ns_) :
+    tick_ns(tick_ns_),
+    now(0),
+    expiry(capacity),
+    next(capacity, none),
+    size_(0)
+  {
+    memset(head, 0xff, sizeof(head));
+    memset(occupied, 0, sizeof(occupied));
+  }
+
+  size_t size() const { return size_; }
+
+  /// Schedule an identifier which is not in the wheel to expire at time t, in
+  /// nanoseconds.  Times not after the current tick expire at the next one,
+  /// and times too far in the future are brought closer.
+  void schedule(uint32_t id, int64_t t)
+  {
+    uint64_t e = t > 0 ? uint64_t(t / tick_ns) : 0;
+    if(e <= now) e = now + 1;
+    if(e - now >= (uint64_t(1) << (slot_bits * levels))) e = now + (uint64_t(1) << (slot_bits * levels)) - 1;
+    expiry[id] = e;
+    insert(id);
+    size_ ++;
+  }
+
+  /// Return a time in nanoseconds before which no identifier expires.
+  int64_t next_expiry() const
+  {
+    const nat slot = find_level0(((now + 1) & slot_mask) ? (now + 1) & slot_mask : slots);
+    const uint64_t base = now & ~uint64_t(slot_mask);
+    return (slot < slots ? base + slot : base + slots) * tick_ns;
+  }
+
+  /// Advance to time t, in nanoseconds, calling f(id) for each identifier
+  /// expiring up to then.  f may schedule identifiers again.
+  template<typename F>
+  void advance(int64_t t, F f)
+  {
+    const uint64_t target = t > 0 ? uint64_t(t / tick_ns) : 0;
+
+    while(now < target)
+    {
+      // Next occupied level 0 slot in this period, or the next period
+      const nat from = (now + 1) & slot_mask;
+      const nat slot = from ? find_level0(from) : slots;
+      const uint64_t tick = (now & ~uint64_t(slot_mask)) + slot;
+      if(tick > target)
+      {
+        now = target;
+        break;
+      }
+
+      now = tick;
+      if((now & slot_mask) == 0)
+      {
+        nat level = 1;
+        while(level < levels - 1 && ((now >> (slot_bits * level)) & slot_mask) == 0) level ++;
+        for(; level >= 1; level --) cascade(level);
+      }
+
+      uint32_t id = take(0, now & slot_mask);
+      while(id != none)
+      {
+        const uint32_t following = next[id];
+        next[id] = none;
+        size_ --;
+        f(id);
+        id = following;
+      }
+    }
+  }
+};
+
+#endif
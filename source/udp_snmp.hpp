@@ -0,0 +1,60 @@
+// udp_snmp.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef UDP_SNMP_HPP_20261019
+#define UDP_SNMP_HPP_20261019
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "shorthands.hpp"
+
+/// System-wide UDP error counters, as found in /proc/net/snmp.
+struct udp_snmp
+{
+  bool valid;
+  uint64_t in_errors, rcvbuf_errors;
+
+  udp_snmp() : valid(false), in_errors(0), rcvbuf_errors(0) { }
+
+  /// Sample the counters.  The result is not valid if /proc/net/snmp cannot be
+  /// read or lacks the counters.
+  static udp_snmp read()
+  {
+    udp_snmp r;
+    std::ifstream in("/proc/net/snmp");
+    std::string names, values;
+
+    // The Udp: line with the counter names is followed by one with the values
+    while(std::getline(in, names))
+    {
+      if(names.compare(0, 4, "Udp:") == 0 && std::getline(in, values)) break;
+    }
+    if(values.compare(0, 4, "Udp:") != 0) return r;
+
+    std::stringstream n(names.substr(4)), v(values.substr(4));
+    std::string name;
+    uint64_t value;
+    bool have_in_errors = false, have_rcvbuf_errors = false;
+    while(n >> name && v >> value)
+    {
+      if(name == "InErrors")
+      {
+        r.in_errors = value;
+        have_in_errors = true;
+      }
+      else if(name == "RcvbufErrors")
+      {
+        r.rcvbuf_errors = value;
+        have_rcvbuf_errors = true;
+      }
+    }
+    r.valid = have_in_errors && have_rcvbuf_errors;
+    return r;
+  }
+};
+
+#endif
@@ -0,0 +1,764 @@
+// udpanalyze
+//
+// Join a transmission log and a reception log on sequence numbers and compute
+// one-way delays, loss bursts, reordering and per-second time series.
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <boost/program_options.hpp>
+
+#include "shorthands.hpp"
+#include "mapped_file.hpp"
+#include "log_codec.hpp"
+#include "rx_status.hpp"
+#include "histogram.hpp"
+#include "packet_header.hpp"
+
+namespace po = boost::program_options;
+using namespace std;
+
+const char *progname = "";
+
+enum
+{
+  absent         = 0xffff, // Size of sequence numbers missing from the transmission log
+  max_extent     = 1024,   // Reordering extents above this are counted together
+  write_batch    = 65536,
+  parse_window   = 1 << 24, // Bytes of a text log parsed by a thread before dropping them from memory
+  spill_batch    = 2048,   // Records buffered per thread and partition before being appended to a spill file
+  reserved_files = 64      // File descriptors kept for other uses than spill files
+};
+
+/// Per-packet record of the binary output file.
+struct packet_record
+{
+  uint64_t seq;
+  int64_t t_tx;    // Transmission time, sender clock, microseconds
+  int64_t t_rx;    // First reception time, receiver clock, or INT64_MIN if lost
+  uint32_t size;
+  uint32_t copies; // Number of times the packet was received
+};
+
+struct second_stats
+{
+  uint64_t tx, rx, lost, dup, bytes;
+  int64_t delay_min, delay_max;
+  double delay_sum, jitter_sum;
+  uint64_t jitter_n;
+
+  second_stats() : tx(0), rx(0), lost(0), dup(0), bytes(0), delay_min(0), delay_max(0),
+                   delay_sum(0), jitter_sum(0), jitter_n(0) { }
+
+  void merge(const second_stats& s)
+  {
+    if(s.rx && (!rx || s.delay_min < delay_min)) delay_min = s.delay_min;
+    if(s.rx && (!rx || s.delay_max > delay_max)) delay_max = s.delay_max;
+    tx += s.tx;
+    rx += s.rx;
+    lost += s.lost;
+    dup += s.dup;
+    bytes += s.bytes;
+    delay_sum += s.delay_sum;
+    jitter_sum += s.jitter_sum;
+    jitter_n += s.jitter_n;
+  }
+};
+
+struct burst
+{
+  uint64_t first, length;
+};
+
+/// Compact record of a partition, as stored in its spill file.
+struct spill_record
+{
+  int64_t t;       // Transmission or reception time
+  uint32_t offset; // Sequence number relative to the first one of the partition
+  uint16_t size;   // Transmission size, capped below absent, or 0 for a reception
+  uint16_t pad;
+};
+
+/// Summary of the chunk of the reception log scanned by one thread.
+struct rx_chunk
+{
+  bool any;       // True if the chunk has undamaged packets
+  uint64_t first; // Sequence number of the first undamaged packet, as logged
+  uint64_t high;  // Highest sequence number, unwrapped from first + 2^32 if sequence numbers wrap
+
+  rx_chunk() : any(false), first(0), high(0) { }
+};
+
+/// \brief Unlinked temporary files collecting the records of each partition.
+/// Threads append whole batches to files opened with O_APPEND, so that no
+/// locking is needed; the order of the batches is unspecified.
+class spill_files
+{
+  vector<int> fds;
+
+  spill_files(const spill_files&);
+  spill_files& operator=(const spill_files&);
+
+  void close_all()
+  {
+    for(size_t p = 0; p < fds.size(); p ++) if(fds[p] >= 0) close(fds[p]);
+  }
+
+public:
+  /// \throws std::runtime_error if a file cannot be created in dir
+  spill_files(nat parts, const string& dir) : fds(parts, -1)
+  {
+    for(nat p = 0; p < parts; p ++)
+    {
+      string name = dir + "/udpanalyze-XXXXXX";
+      fds[p] = mkstemp(&name[0]);
+      if(fds[p] < 0 || unlink(name.c_str()) < 0 || fcntl(fds[p], F_SETFL, O_APPEND) < 0)
+      {
+        const string error = strerror(errno);
+        close_all();
+        throw runtime_error("Cannot create a temporary file in " + dir + ": " + error);
+      }
+    }
+  }
+
+  ~spill_files() { close_all(); }
+
+  nat size() const { return fds.size(); }
+
+  void append(nat p, const spill_record *r, size_t n)
+  {
+    const size_t bytes = n * sizeof(spill_record);
+    if(write(fds[p], r, bytes) != ssize_t(bytes))
+      throw runtime_error(string("Cannot write temporary file: ") + strerror(errno));
+  }
+
+  /// Read all the records of partition p.
+  void load(nat p, vector<spill_record>& out) const
+  {
+    struct stat st;
+    if(fstat(fds[p], &st) < 0) throw runtime_error(string("Cannot stat temporary file: ") + strerror(errno));
+    out.resize(st.st_size / sizeof(spill_record));
+    const size_t bytes = out.size() * sizeof(spill_record);
+    for(size_t done = 0; done < bytes; )
+    {
+      const ssize_t m = pread(fds[p], reinterpret_cast<char *>(out.data()) + done, bytes - done, done);
+      if(m <= 0) throw runtime_error(string("Cannot read temporary file: ") + (m < 0 ? strerror(errno) : "short file"));
+      done += m;
+    }
+  }
+
+  /// Close the file of partition p, releasing its disk space.
+  void release(nat p)
+  {
+    close(fds[p]);
+    fds[p] = -1;
+  }
+};
+
+/// Batches of one thread awaiting their append to the spill files.
+class spill_buffer
+{
+  spill_files& files;
+  vector< vector<spill_record> > pending;
+
+public:
+  spill_buffer(spill_files& files_) : files(files_), pending(files_.size()) { }
+
+  void add(nat p, const spill_record& r)
+  {
+    vector<spill_record>& b = pending[p];
+    if(b.empty()) b.reserve(spill_batch);
+    b.push_back(r);
+    if(b.size() == spill_batch)
+    {
+      files.append(p, b.data(), b.size());
+      b.clear();
+    }
+  }
+
+  void flush()
+  {
+    for(nat p = 0; p < pending.size(); p ++)
+    {
+      if(!pending[p].empty()) files.append(p, pending[p].data(), pending[p].size());
+      vector<spill_record>().swap(pending[p]);
+    }
+  }
+};
+
+/// Run f(k) for k in [0, threads) on as many threads.
+template<typename F>
+void parallel(nat threads, F f)
+{
+  vector<thread> workers;
+  vector<exception_ptr> errors(threads);
+  for(nat k = 0; k < threads; k ++)
+  {
+    workers.push_back(thread([&, k]()
+    {
+      try
+      {
+        f(k);
+      }
+      catch(...)
+      {
+        errors[k] = current_exception();
+      }
+    }));
+  }
+  for(nat k = 0; k < threads; k ++) workers[k].join();
+  for(nat k = 0; k < threads; k ++) if(errors[k]) rethrow_exception(errors[k]);
+}
+
+// Parse a text log slice [p, end) starting at a line boundary, calling f on each record
+template<typename F>
+static void parse_text(const char *p, const char *end, log_kind kind, F f)
+{
+  while(p < end)
+  {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if(!eol) eol = end;
+    const char *q = p;
+    p = eol + 1;
+    if(q == eol || *q < '0' || *q > '9') continue; // Header or comment
+
+    log_record r;
+    memset(&r, 0, sizeof(r));
+    uint64_t fields[6];
+    nat n = 0;
+
+    while(q < eol && n < 6)
+    {
+      while(q < eol && *q == ' ') q ++;
+      if(q == eol) break;
+      if(kind == log_rx && n == 2)
+      {
+        const char *s = q;
+        while(q < eol && *q != ' ') q ++;
+        // Nearly all packets are fine, and matching status names is the costliest part of a line
+        const int status = q - s == 2 && s[0] == 'o' && s[1] == 'k' ? 0 : rx_status_parse(string(s, q));
+        fields[n ++] = status < 0 ? rx_bad : status;
+        continue;
+      }
+      uint64_t x = 0;
+      while(q < eol && *q >= '0' && *q <= '9') x = 10 * x + (*(q ++) - '0');
+      fields[n ++] = x;
+    }
+
+    if(kind == log_tx && n >= 3)
+    {
+      r.t = fields[0];
+      r.size = fields[1];
+      r.seq = fields[2];
+      f(r);
+    }
+    else if(kind == log_rx && n >= 6)
+    {
+      r.t = fields[0];
+      r.size = fields[1];
+      r.status = fields[2];
+      r.seq = fields[3];
+      r.t_tx = fields[4];
+      r.errors = fields[5];
+      f(r);
+    }
+  }
+}
+
+/// Scan a text or compressed log in parallel, calling f(k, record) on the
+/// records of the k-th chunk of the file in file order.  The chunk of each
+/// thread is the same from one scan to the next.
+template<typename F>
+static void scan_log(const string& path, log_kind kind, nat threads, F f)
+{
+  if(compressed_log_reader::is_compressed(path))
+  {
+    compressed_log_reader reader(path);
+    if(reader.kind() != kind) throw runtime_error(path + " is not a " + (kind == log_tx ? "transmission" : "reception") + " log");
+    const size_t nb = reader.blocks();
+    parallel(threads, [&](nat k)
+    {
+      vector<log_record> records;
+      vector<log_missing> missing;
+      for(size_t b = nb * k / threads; b < nb * (k + 1) / threads; b ++)
+      {
+        reader.decode(b, records, missing);
+        for(size_t i = 0; i < records.size(); i ++) f(k, records[i]);
+      }
+    });
+  }
+  else
+  {
+    mapped_file file(path);
+    const char *p = file.data(), *end = p + file.size();
+    vector<const char *> cuts(threads + 1);
+    cuts[0] = p;
+    cuts[threads] = end;
+    for(nat k = 1; k < threads; k ++)
+    {
+      const char *c = max(cuts[k - 1], p + file.size() * k / threads);
+      const char *eol = c < end ? static_cast<const char *>(memchr(c, '\n', end - c)) : NULL;
+      cuts[k] = eol ? eol + 1 : end;
+    }
+    parallel(threads, [&](nat k)
+    {
+      // Parse by windows, whose pages are dropped once parsed to keep the resident set small
+      for(const char *w0 = cuts[k], *w1; w0 < cuts[k + 1]; w0 = w1)
+      {
+        w1 = min(cuts[k + 1], w0 + parse_window);
+        const char *eol = static_cast<const char *>(memchr(w1, '\n', cuts[k + 1] - w1));
+        w1 = eol ? eol + 1 : cuts[k + 1];
+        parse_text(w0, w1, kind, [&](const log_record& r) { f(k, r); });
+        file.drop(w0, w1);
+      }
+    });
+  }
+}
+
+/// Unwrap a 32-bit sequence number around the highest one seen so far.
+static uint64_t unwrap(uint64_t seq, uint64_t high)
+{
+  uint64_t s = (high & ~uint64_t(UINT32_MAX)) | (seq & UINT32_MAX);
+  if(s + (uint64_t(1) << 31) < high) s += uint64_t(1) << 32;
+  else if(s > high + (uint64_t(1) << 31) && s >= (uint64_t(1) << 32)) s -= uint64_t(1) << 32;
+  return s;
+}
+
+/// Raise the limit on open files as far as allowed, and return it.
+static nat open_files_limit()
+{
+  struct rlimit rl;
+  if(getrlimit(RLIMIT_NOFILE, &rl) < 0) return 1024;
+  if(rl.rlim_cur < rl.rlim_max)
+  {
+    const rlim_t current = rl.rlim_cur;
+    rl.rlim_cur = rl.rlim_max;
+    if(setrlimit(RLIMIT_NOFILE, &rl) < 0) rl.rlim_cur = current;
+  }
+  return min<rlim_t>(rl.rlim_cur, 1 << 20);
+}
+
+/// Load partition p from its spill file into dense tables of transmission
+/// times and sizes, leaving its receptions in records.
+static void load_partition(const spill_files& files, nat p, size_t n, vector<spill_record>& records,
+                           vector<int64_t>& tx_t, vector<uint16_t>& tx_size)
+{
+  files.load(p, records);
+  tx_t.assign(n, 0);
+  tx_size.assign(n, uint16_t(absent));
+  size_t m = 0;
+  for(size_t j = 0; j < records.size(); j ++)
+  {
+    const spill_record& r = records[j];
+    if(r.size)
+    {
+      tx_t[r.offset] = r.t;
+      tx_size[r.offset] = r.size;
+    }
+    else records[m ++] = r;
+  }
+  records.resize(m);
+}
+
+int main(int argc, char *argv[])
+{
+  progname = argv[0];
+
+  string tx_file, rx_file, prefix, temp_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  nat threads = thread::hardware_concurrency();
+  uint64_t partition_size = 1 << 20;
+  bool per_packet = false;
+
+  po::options_description desc("Available options");
+  desc.add_options()
+    ("help,h",                                                "Display this information")
+    ("tx",             po::value<string>(&tx_file),           "Transmission log (text or compressed)")
+    ("rx",             po::value<string>(&rx_file),           "Reception log (text or compressed)")
+    ("output-prefix",  po::value<string>(&prefix),            "Prefix for output file names")
+    ("threads",        po::value<nat>(&threads),              "Number of threads (default: number of cores)")
+    ("per-packet",     po::bool_switch(&per_packet),          "Write per-packet records to a binary file")
+    ("partition-size", po::value<uint64_t>(&partition_size),  "Sequence numbers joined at once by each thread (default 1048576)")
+    ("temp-dir",       po::value<string>(&temp_dir),          "Directory of the temporary partition files (default $TMPDIR or /tmp)")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if(vm.count("help") || tx_file.empty() || rx_file.empty())
+    {
+      cout << "Usage: " << progname << " --tx file.txl --rx file.rxl [options]" << endl << desc << endl;
+      return 1;
+    }
+    if(threads == 0) threads = 1;
+    if(partition_size == 0) partition_size = 1;
+
+    // Ranges of the transmission log.  Packets too short to carry a header
+    // are not decodable and are left out.
+    vector<uint64_t> seq_lo(threads, UINT64_MAX), seq_hi(threads, 0);
+    vector<int64_t> t_lo(threads, INT64_MAX), t_hi(threads, INT64_MIN);
+    cout << "Scanning " << tx_file << endl;
+    scan_log(tx_file, log_tx, threads, [&](nat k, const log_record& r)
+    {
+      if(r.size < packet_header::encoded_size) return;
+      seq_lo[k] = min(seq_lo[k], r.seq);
+      seq_hi[k] = max(seq_hi[k], r.seq);
+      t_lo[k] = min(t_lo[k], r.t);
+      t_hi[k] = max(t_hi[k], r.t);
+    });
+    const uint64_t seq0 = *min_element(seq_lo.begin(), seq_lo.end()), seq1 = *max_element(seq_hi.begin(), seq_hi.end());
+    const int64_t t0 = *min_element(t_lo.begin(), t_lo.end()), t1 = *max_element(t_hi.begin(), t_hi.end());
+    if(seq0 > seq1) throw runtime_error("No decodable packets in transmission log");
+
+    // Reception logs carry 32-bit sequence numbers, unwrapped around the
+    // highest undamaged sequence number received so far.  Each chunk is first
+    // unwrapped on its own from its first packet, and is then placed after
+    // the previous ones, which gives the same result as a sequential
+    // unwrapping unless the first packet of a chunk is late by 2^31.
+    const bool wrap = seq1 > UINT32_MAX;
+    vector<rx_chunk> rx_chunks(threads);
+    cout << "Scanning " << rx_file << endl;
+    scan_log(rx_file, log_rx, threads, [&](nat k, const log_record& r)
+    {
+      if(r.status & rx_damaged) return;
+      rx_chunk& c = rx_chunks[k];
+      if(!c.any)
+      {
+        c.any = true;
+        c.first = r.seq;
+        c.high = wrap ? (r.seq & UINT32_MAX) + (uint64_t(1) << 32) : r.seq;
+      }
+      else c.high = max(c.high, wrap ? unwrap(r.seq, c.high) : r.seq);
+    });
+
+    // Highest sequence number before each chunk, for unwrapping and for
+    // reordering: a packet is late by the difference between the highest
+    // sequence number received before it and its own.
+    vector<char> any_before(threads, false);
+    vector<uint64_t> high_before(threads, 0);
+    {
+      bool any = false;
+      uint64_t high = 0;
+      for(nat k = 0; k < threads; k ++)
+      {
+        any_before[k] = any;
+        high_before[k] = high;
+        const rx_chunk& c = rx_chunks[k];
+        if(!c.any) continue;
+        uint64_t h = c.high;
+        if(wrap) h += unwrap(c.first, any ? max(seq0, high) : seq0) - ((c.first & UINT32_MAX) + (uint64_t(1) << 32));
+        high = any ? max(high, h) : h;
+        any = true;
+      }
+    }
+
+    // Partition both logs by sequence number range into temporary files of
+    // compact records, so that memory only holds one partition per thread.
+    const uint64_t span = seq1 - seq0 + 1;
+    const nat max_parts = max<nat>(1, open_files_limit() - reserved_files);
+    const uint64_t part_span = max(partition_size, (span + max_parts - 1) / max_parts);
+    if(part_span > UINT32_MAX) throw runtime_error("Sequence numbers of the transmission log span too wide a range");
+    const nat parts = (span + part_span - 1) / part_span;
+    spill_files spill(parts, temp_dir);
+    cout << "Partitioning into " << parts << " partitions of " << part_span << " sequence numbers" << endl;
+
+    vector<spill_buffer> buffers(threads, spill_buffer(spill));
+    scan_log(tx_file, log_tx, threads, [&](nat k, const log_record& r)
+    {
+      if(r.size < packet_header::encoded_size) return;
+      const uint64_t i = r.seq - seq0;
+      const spill_record x = { r.t, uint32_t(i % part_span), uint16_t(min<uint32_t>(r.size, absent - 1)), 0 };
+      buffers[k].add(i / part_span, x);
+    });
+    for(nat k = 0; k < threads; k ++) buffers[k].flush();
+
+    vector< vector<uint64_t> > extents(threads, vector<uint64_t>(max_extent + 2, 0));
+    vector<uint64_t> unknown(threads, 0);
+    {
+      vector<uint64_t> high(threads), reorder_high(high_before);
+      vector<char> any(any_before);
+      for(nat k = 0; k < threads; k ++) high[k] = any[k] ? max(seq0, high_before[k]) : seq0;
+      scan_log(rx_file, log_rx, threads, [&](nat k, const log_record& r)
+      {
+        if(r.status & rx_damaged) return;
+        uint64_t seq = r.seq;
+        if(wrap)
+        {
+          seq = unwrap(r.seq, high[k]);
+          high[k] = max(high[k], seq);
+        }
+        if(any[k] && seq < reorder_high[k])
+        {
+          extents[k][min<uint64_t>(reorder_high[k] - seq, max_extent + 1)] ++;
+        }
+        reorder_high[k] = any[k] ? max(reorder_high[k], seq) : seq;
+        any[k] = true;
+
+        if(seq < seq0 || seq > seq1)
+        {
+          unknown[k] ++;
+          return;
+        }
+        const spill_record x = { r.t, uint32_t((seq - seq0) % part_span), 0, 0 };
+        buffers[k].add((seq - seq0) / part_span, x);
+      });
+      for(nat k = 0; k < threads; k ++) buffers[k].flush();
+    }
+
+    // Delays include the unknown offset between the clocks.  The delay
+    // histogram is log-bucketed, so delays are taken relative to the smallest
+    // one to keep its resolution.
+    vector<int64_t> min_delay(threads, INT64_MAX);
+    atomic<nat> next_part(0);
+    parallel(threads, [&](nat k)
+    {
+      vector<spill_record> records;
+      vector<int64_t> tx_t;
+      vector<uint16_t> tx_size;
+
+      for(nat p; (p = next_part ++) < parts; )
+      {
+        load_partition(spill, p, min(span - p * part_span, part_span), records, tx_t, tx_size);
+        for(size_t j = 0; j < records.size(); j ++)
+        {
+          const spill_record& r = records[j];
+          if(tx_size[r.offset] != absent) min_delay[k] = min(min_delay[k], r.t - tx_t[r.offset]);
+        }
+      }
+    });
+    const int64_t delay_base = *min_element(min_delay.begin(), min_delay.end());
+
+    // Join the partitions
+    const int64_t seconds = (t1 - t0) / 1000000 + 1;
+    vector< vector<second_stats> > per_second(threads);
+    vector< vector<burst> > bursts(parts);
+    vector<histogram> delays(threads);
+    vector<uint64_t> sent(threads, 0), received(threads, 0), lost(threads, 0), duplicates(threads, 0);
+    next_part = 0;
+
+    int fd = -1;
+    if(per_packet)
+    {
+      const string path = prefix + "packets.bin";
+      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd < 0) throw runtime_error("Cannot create " + path + ": " + strerror(errno));
+    }
+
+    parallel(threads, [&](nat k)
+    {
+      vector<spill_record> records;
+      vector<int64_t> tx_t, t_rx;
+      vector<uint16_t> tx_size;
+      vector<uint32_t> copies;
+      vector<packet_record> out;
+      vector<second_stats>& ps = per_second[k];
+      ps.resize(seconds);
+
+      for(nat p; (p = next_part ++) < parts; )
+      {
+        const uint64_t i0 = p * part_span, n = min(span - i0, part_span);
+        load_partition(spill, p, n, records, tx_t, tx_size);
+        spill.release(p);
+        t_rx.assign(n, INT64_MIN);
+        copies.assign(n, 0);
+
+        // Batches were appended in any order, so the first reception is the earliest one
+        for(size_t j = 0; j < records.size(); j ++)
+        {
+          const spill_record& r = records[j];
+          if(tx_size[r.offset] == absent)
+          {
+            unknown[k] ++;
+            continue;
+          }
+          if(!copies[r.offset] ++ || r.t < t_rx[r.offset]) t_rx[r.offset] = r.t;
+        }
+
+        int64_t previous_delay = 0;
+        bool have_previous = false;
+
+        for(uint64_t i = 0; i < n; i ++)
+        {
+          if(tx_size[i] == absent) continue;
+          second_stats& s = ps[(tx_t[i] - t0) / 1000000];
+          sent[k] ++;
+          s.tx ++;
+          s.bytes += tx_size[i];
+
+          const uint32_t c = copies[i];
+          if(c == 0)
+          {
+            lost[k] ++;
+            s.lost ++;
+            vector<burst>& bs = bursts[p];
+            if(!bs.empty() && bs.back().first + bs.back().length == seq0 + i0 + i) bs.back().length ++;
+            else
+            {
+              const burst b = { seq0 + i0 + i, 1 };
+              bs.push_back(b);
+            }
+            continue;
+          }
+
+          received[k] ++;
+          duplicates[k] += c - 1;
+          s.dup += c - 1;
+
+          const int64_t d = t_rx[i] - tx_t[i];
+          if(!s.rx || d < s.delay_min) s.delay_min = d;
+          if(!s.rx || d > s.delay_max) s.delay_max = d;
+          s.rx ++;
+          s.delay_sum += d;
+          if(have_previous)
+          {
+            s.jitter_sum += llabs(d - previous_delay);
+            s.jitter_n ++;
+          }
+          previous_delay = d;
+          have_previous = true;
+          delays[k].add(d - delay_base);
+        }
+
+        if(fd >= 0)
+        {
+          for(uint64_t b0 = 0; b0 < n; b0 += write_batch)
+          {
+            const uint64_t b1 = min(n, b0 + write_batch);
+            out.resize(b1 - b0);
+            for(uint64_t i = b0; i < b1; i ++)
+            {
+              packet_record& r = out[i - b0];
+              r.seq = seq0 + i0 + i;
+              r.t_tx = tx_size[i] == absent ? INT64_MIN : tx_t[i];
+              r.t_rx = t_rx[i];
+              r.size = tx_size[i] == absent ? 0 : tx_size[i];
+              r.copies = copies[i];
+            }
+            const size_t bytes = out.size() * sizeof(packet_record);
+            if(pwrite(fd, out.data(), bytes, (i0 + b0) * sizeof(packet_record)) != ssize_t(bytes))
+              throw runtime_error(string("Cannot write per-packet file: ") + strerror(errno));
+          }
+        }
+      }
+    });
+
+    if(fd >= 0) close(fd);
+
+    // Merge the results of the threads and partitions
+    vector<second_stats> total_seconds(seconds);
+    histogram delay;
+    vector<uint64_t> extent(max_extent + 2, 0);
+    uint64_t n_sent = 0, n_received = 0, n_lost = 0, n_dup = 0, n_unknown = 0, n_reordered = 0;
+    vector<burst> all_bursts;
+
+    for(nat k = 0; k < threads; k ++)
+    {
+      for(int64_t s = 0; s < int64_t(per_second[k].size()); s ++) total_seconds[s].merge(per_second[k][s]);
+      delay.merge(delays[k]);
+      n_sent += sent[k];
+      n_received += received[k];
+      n_lost += lost[k];
+      n_dup += duplicates[k];
+      n_unknown += unknown[k];
+      for(nat e = 0; e < max_extent + 2; e ++)
+      {
+        extent[e] += extents[k][e];
+        n_reordered += extents[k][e];
+      }
+    }
+    for(nat p = 0; p < parts; p ++)
+    {
+      for(size_t j = 0; j < bursts[p].size(); j ++)
+      {
+        const burst& b = bursts[p][j];
+        if(!all_bursts.empty() && all_bursts.back().first + all_bursts.back().length == b.first)
+          all_bursts.back().length += b.length;
+        else
+          all_bursts.push_back(b);
+      }
+    }
+
+    // Output
+    {
+      ofstream out((prefix + "seconds.csv").c_str());
+      out << "second,tx,rx,lost,dup,bytes,delay_min,delay_mean,delay_max,jitter\n";
+      for(int64_t s = 0; s < seconds; s ++)
+      {
+        const second_stats& x = total_seconds[s];
+        out << s << "," << x.tx << "," << x.rx << "," << x.lost << "," << x.dup << "," << x.bytes << ",";
+        if(x.rx) out << x.delay_min << "," << x.delay_sum / x.rx << "," << x.delay_max;
+        else out << "NA,NA,NA";
+        out << "," << (x.jitter_n ? x.jitter_sum / x.jitter_n : 0) << "\n";
+      }
+    }
+    {
+      ofstream out((prefix + "bursts.csv").c_str());
+      out << "first,length\n";
+      for(size_t j = 0; j < all_bursts.size(); j ++) out << all_bursts[j].first << "," << all_bursts[j].length << "\n";
+    }
+    {
+      ofstream out((prefix + "reorder.csv").c_str());
+      out << "extent,count\n";
+      for(nat e = 1; e <= max_extent + 1; e ++)
+      {
+        if(extent[e]) out << (e > max_extent ? "Inf" : to_string(e)) << "," << extent[e] << "\n";
+      }
+    }
+
+    uint64_t longest = 0;
+    for(size_t j = 0; j < all_bursts.size(); j ++) longest = max(longest, all_bursts[j].length);
+
+    cout <<
+      "Analysis:\n"
+      "  Sequence numbers ......................... " << seq0 << " to " << seq1 << "\n"
+      "  Sent decodables .......................... " << n_sent << " pk\n"
+      "  Received decodables ...................... " << n_received << " pk\n"
+      "  Lost decodables .......................... " << n_lost << " pk\n"
+      "  Loss ratio ............................... " << (n_sent ? double(n_lost) / n_sent : 0) << "\n"
+      "  Loss bursts .............................. " << all_bursts.size() << ", longest " << longest << " pk\n"
+      "  Duplicate receptions ..................... " << n_dup << " pk\n"
+      "  Reordered packets ........................ " << n_reordered << " pk\n"
+      "  Received but not sent .................... " << n_unknown << " pk\n"
+      "  Relative one-way delay ................... ";
+    if(delay.count() > 0)
+    {
+      cout <<
+        "p50 " << delay.quantile(0.5) << " us, "
+        "p99 " << delay.quantile(0.99) << " us, "
+        "max " << delay.max() << " us";
+    }
+    else cout << "NA";
+    cout << "\n  Output ................................... " << prefix << "{seconds,bursts,reorder}.csv"
+         << (per_packet ? ", " + prefix + "packets.bin" : string()) << endl;
+  }
+  catch(po::error& e)
+  {
+    cerr << progname << ": Error: " << e.what() << endl;
+    cerr << desc << endl;
+    return 1;
+  }
+  catch(exception& e)
+  {
+    cerr << progname << ": Exception: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
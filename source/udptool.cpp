@@ -13,8 +13,24 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <algorithm>
 #include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
@@ -29,6 +45,31 @@
 #include "wprng.hpp"
 #include "packet_header.hpp"
 #include "no_check_socket_option.hpp"
+#include "rx_status.hpp"
+#include "verify_policy.hpp"
+#include "distribution.hpp"
+#include "schedule.hpp"
+#include "scenario.hpp"
+#include "pacer.hpp"
+#include "replay.hpp"
+#include "histogram.hpp"
+#include "pcap_writer.hpp"
+#include "packet_log.hpp"
+#include "packet_transmitter.hpp"
+#include "packet_receiver.hpp"
+#include "impairment.hpp"
+#include "flight_recorder.hpp"
+#include "stage_timer.hpp"
+#include "probes.hpp"
+#include "latency_profile.hpp"
+#include "udp_snmp.hpp"
+#include "control_channel.hpp"
+#include "timing_wheel.hpp"
+#include "flow_table.hpp"
+#include "port_list.hpp"
+#include "packet_ring.hpp"
+#include "perf_counters.hpp"
+#include "delivery.hpp"
 
 namespace po = boost::program_options;
 namespace as = boost::asio;
@@ -41,119 +82,120 @@ bool stop_flag = false;
 as::io_service* service_to_stop = NULL;
 sighandler_t old_sigint_handler = NULL;
 
-string to_string(nat& n)
+void validate(boost::any& v, 
+              const std::vector<std::string>& values,
+              distribution::ptr* target_type, int)
 {
-  stringstream u;
-  u << n;
-  return u.str();
-}
+  const string& u = po::validators::get_single_string(values);
 
-class distribution
-{
-protected:
-  void eat(istream& in, const char c)
+  try
   {
-    char sep; in >> sep;
-    if(sep != c) throw bad_parameters();
+    v = distribution::parse(u);
   }
-
-  void check_eof(istream& in)
+  catch(runtime_error& e)
   {
-    if(in.fail() || !in.eof()) throw bad_parameters();
+    throw po::error(e.what());
   }
+}
 
-public:
-  class bad_parameters { };
-  typedef boost::shared_ptr<distribution> ptr;
-  virtual ~distribution() { }
-  virtual double next() = 0;
-  virtual double mean() = 0;
-};
-
-class dirac : public distribution
+void validate(boost::any& v, 
+              const std::vector<std::string>& values,
+              packet_log::format* target_type, int)
 {
-  double x0;
+  const string& u = po::validators::get_single_string(values);
 
-public:
-  typedef boost::shared_ptr<dirac> ptr;
-  dirac(istream& in)
-  {
-    in >> x0;
-    check_eof(in);
-  }
-  dirac(double x0_) : x0(x0_) { }
-  double next() { return x0; }
-  double mean() { return x0; }
-};
+  if(u == "text")            v = packet_log::text;
+  else if(u == "compressed") v = packet_log::compressed;
+  else throw po::error("Unknown log format " + u);
+}
 
-class uniform : public distribution
+void validate(boost::any& v, 
+              const std::vector<std::string>& values,
+              log_mode* target_type, int)
 {
-  double x0, x1;
+  const string& u = po::validators::get_single_string(values);
 
-public:
-  typedef boost::shared_ptr<uniform> ptr;
-  uniform(istream& in)
+  if(u == "packets") v = log_mode();
+  else if(u.compare(0, 5, "bins:") == 0)
   {
-    in >> x0;
-    eat(in, ',');
-    in >> x1;
-    check_eof(in);
+    stringstream param(u.substr(5));
+    double interval = 0;
+    param >> interval;
+    if(param.fail() || !param.eof() || !(interval >= 1e-3))
+      throw po::error("Bad bin interval, which must be at least 0.001 s");
+    v = log_mode(int64_t(1e6 * interval + 0.5));
   }
-  uniform(double x0_, double x1_) : x0(x0_), x1(x1_) { }
-  double next() { return x0 + (x1 - x0) * drand48(); }
-  double mean() { return 0.5 * (x0 + x1); }
-};
+  else throw po::error("Unknown log mode " + u);
+}
 
 void validate(boost::any& v, 
               const std::vector<std::string>& values,
-              distribution::ptr* target_type, int)
+              verify_mode* target_type, int)
 {
   const string& u = po::validators::get_single_string(values);
 
-  size_t i0 = u.find(':');
-  string kind = "dirac";
-  if(i0 == string::npos)
+  if(u == "none")        v = verify_mode(verify_mode::none);
+  else if(u == "header") v = verify_mode(verify_mode::header);
+  else if(u == "full")   v = verify_mode(verify_mode::full);
+  else if(u.compare(0, 8, "sampled:") == 0)
   {
-    // Assume Dirac by default
-    i0 = -1;
+    stringstream param(u.substr(8));
+    nat every = 0;
+    param >> every;
+    if(param.fail() || !param.eof() || every == 0)
+      throw po::error("Bad sampled verification period");
+    v = verify_mode(verify_mode::sampled, every);
   }
   else
   {
-    kind = u.substr(0, i0);
+    throw po::error("Unknown verification mode " + u);
   }
-  const string param_s = u.substr(i0 + 1);
-  stringstream param(param_s);
-  distribution::ptr content;
+}
 
-  if(kind == "dirac")
-  {
-    try
-    {
-      content = dirac::ptr(new dirac(param));
-    }
-    catch(...)
-    {
-      throw po::validation_error("Bad Dirac distribution description");
-    }
-  }
-  else if(kind == "uniform")
+template<class T>
+void validate_parsed(boost::any& v, const std::vector<std::string>& values)
+{
+  const string& u = po::validators::get_single_string(values);
+
+  try
   {
-    try
-    {
-      content = uniform::ptr(new uniform(param));
-    }
-    catch(...)
-    {
-      throw po::validation_error("Bad uniform distribution description");
-    }
+    v = T::parse(u);
   }
-  else
+  catch(runtime_error& e)
   {
-    string u = "Unknown distribution kind ";
-    u += kind;
-    throw po::validation_error(u);
+    throw po::error(e.what());
   }
-  v = content;
+}
+
+void validate(boost::any& v, const std::vector<std::string>& values, gilbert_elliott* target_type, int)
+{
+  validate_parsed<gilbert_elliott>(v, values);
+}
+
+void validate(boost::any& v, const std::vector<std::string>& values, reorder_model* target_type, int)
+{
+  validate_parsed<reorder_model>(v, values);
+}
+
+void validate(boost::any& v, const std::vector<std::string>& values, corruption_model* target_type, int)
+{
+  validate_parsed<corruption_model>(v, values);
+}
+
+void validate(boost::any& v, const std::vector<std::string>& values, port_list* target_type, int)
+{
+  validate_parsed<port_list>(v, values);
+}
+
+void validate(boost::any& v, 
+              const std::vector<std::string>& values,
+              payload_integrity* target_type, int)
+{
+  const string& u = po::validators::get_single_string(values);
+
+  if(u == "pattern")     v = integrity_pattern;
+  else if(u == "crc32c") v = integrity_crc32c;
+  else throw po::error("Unknown integrity check " + u);
 }
 
 enum
@@ -161,13 +203,47 @@ enum
  display_delay_microseconds = 1000000,
  display_every = 100,
  default_size  = 1472,
- default_delay = 1
+ default_delay = 1,
+ max_size      = 65507,
+ send_batch    = 64,
+ poll_timers_every = 256, // Packets received between timer checks when polling
+ receive_batch = 64,      // Packets received per socket and event loop wakeup
+ epoll_batch = 256,       // Ready sockets served per event loop wakeup
+ rx_worker_ring = 1024,   // Packets queued to each --rx-workers thread
+ follow_min_packets = 1000, // Packets needed to move the receiving thread with --follow-incoming-cpu
+ reserved_files = 64,     // Open files needed besides the sockets and logs of the receiver
+ idle_poll_timeout = 1,   // Longest wait for a packet when polling, in ms
+ default_search_rate = 1000,          // Highest rate tried by --search-throughput, in Mbit/s
+ trial_drain_microseconds = 200000,   // Wait for packets in flight at the end of a trial
+ flow_tick_ns = 1000,                 // Resolution of the multi-flow timing wheel
+ default_bench_packets = 200000,      // Packets per --loopback-bench case
+ bench_rcvbuf = 4 << 20,              // Receive buffer of --loopback-bench, in bytes
+ default_flow_rate = 100              // Packets per second of each flow from --flow-range
+};
+
+// Throughput searches stop when the rate is known within this fraction of the highest rate
+const double search_resolution = 0.01;
+
+// Default sizes for --search-throughput: the UDP payloads of the RFC 2544
+// Ethernet frame sizes over IPv4
+const nat default_search_sizes[] = { 18, 82, 210, 466, 978, 1234, 1472 };
+
+// Packet sizes of --loopback-bench
+const nat bench_sizes[] = { 64, 512, 1472 };
+
+// Random number streams, one per generator
+enum
+{
+ rng_stream_schedule = 1,
+ rng_stream_loss     = 2
 };
 
 struct our_options
 {
   string s_ip, d_ip;
+  vector<string> s_ips;
   nat port, tx_src_port;
+  port_list ports;
   nat count;
   bool verbose;
   string log_file_prefix, log_file_suffix;
@@ -176,16 +252,50 @@ struct our_options
   nat avg_window, max_window, miss_window;
   bool transmit, receive;
   size_t rx_buf_size;
+  nat rx_workers;
+  int rcvbuf;
   double p_loss;
+  impairment_settings impair;
+  string impairment_log;
+  uint64_t seed;
+  double spin;
+  nat tx_pipeline;
+  vector<distribution::ptr> sizes, delays;
+  string scenario_file;
+  string replay_file;
+  double replay_speed;
+  verify_mode verify;
+  payload_integrity integrity;
+  packet_log::format log_format;
+  log_mode log_granularity;
+  flight_recorder_settings flight;
+  string decode_log_file;
+  string pcap_file;
+  bool pcap_anomalous;
+  size_t pcap_snaplen;
+  bool low_latency;
+  bool perf_counters;
+  int cpu, rt_priority;
+  nat busy_poll;
+  bool incoming_cpu, follow_incoming_cpu;
+  nat control_port;
+  bool search;
+  bool bench;
+  vector<nat> search_sizes;
+  double trial_duration, loss_tolerance;
+  string flows_file, flow_stats_file;
+  vector<string> flow_ranges;
+  double flow_rate;
+  size_t flow_size;
 #if HAVE_SO_NO_CHECK
   bool no_check;
 #endif
-  vector<distribution::ptr> sizes, delays;
 
   our_options() :
     s_ip("0.0.0.0"),
     port(33333),
     tx_src_port(0),
+    ports(33333),
     count(0),
     verbose(false),
     bandwidth(0),
@@ -194,9 +304,33 @@ struct our_options
     avg_window(10000), max_window(10000), miss_window(50),
     transmit(false), receive(false),
     rx_buf_size(10000),
+    rx_workers(0),
+    rcvbuf(0),
     p_loss(0),
+    seed(0),
+    spin(0),
+    tx_pipeline(0),
+    replay_speed(1),
+    integrity(integrity_pattern),
+    log_format(packet_log::text),
+    pcap_anomalous(false),
+    pcap_snaplen(65535),
+    low_latency(false),
+    perf_counters(false),
+    cpu(-1),
+    rt_priority(0),
+    busy_poll(50),
+    incoming_cpu(false),
+    follow_incoming_cpu(false),
+    control_port(0),
+    search(false),
+    bench(false),
+    trial_duration(2),
+    loss_tolerance(0),
+    flow_rate(default_flow_rate),
+    flow_size(default_size)
 #if HAVE_SO_NO_CHECK
-    no_check(false)
+    , no_check(false)
 #endif
   {
   }
@@ -204,440 +338,980 @@ struct our_options
 
 static our_options opt;
 
-class packet_transmitter
+/// Open a packet log, behind a flight recorder with --flight-recorder.
+static packet_log::ptr open_log(log_kind kind, const string& path, flight_recorder::ptr& recorder)
 {
-  ofstream log; 
-  uint64_t seq;
-  rtclock clk;
+  packet_log::ptr log = packet_log::create(opt.log_format, kind, path, opt.log_granularity);
+  if(opt.flight.before > 0)
+  {
+    recorder.reset(new flight_recorder(log, kind, path, opt.flight));
+    log = recorder;
+  }
+  return log;
+}
+
+const char *progname = "";
+
+using as::ip::udp;
+
+boost::system::error_code no_error;
+
+class periodic
+{
+  boost::function<void()> method;
+  as::io_service& io;
+  as::deadline_timer timer;
+  boost::posix_time::microseconds interval;
+  bool first;
 
 public:
-  packet_transmitter(const string& log_file) :
-    log(log_file), seq(0)
+  periodic(
+      as::io_service& io_,
+      double interval_,
+      boost::function<void()> method_
+    ) :
+    method(method_),
+    io(io_),
+    timer(io),
+    interval(int64_t(1e6 * interval_)),
+    first(true)
   {
-    log << "t_tx size seq" << endl;
+    if(interval_ > 0)
+      rearm();
   }
 
-  virtual ~packet_transmitter() { } 
+  virtual ~periodic() { }
 
-  void transmit(char *buffer, const size_t m0)
+  void rearm(const boost::system::error_code& error=no_error)
   {
-    int64_t t_tx = clk.get();
-    log << t_tx << " " << m0 << " " << seq << "\n";
-    if(m0 < packet_header::encoded_size) return;
-    size_t m = m0;
-    packet_header ph(uint32_t(t_tx), m0 - packet_header::encoded_size, seq);
-    stringstream s;
-    ph.encode(s, m);
-    wprng w(ph.check);
-    for(nat i = 0; i < m; i ++)
+    if(error != as::error::operation_aborted)
     {
-       s.put(w.get());
+      if(first) first = false;
+      else method();
+
+      timer.expires_from_now(interval);
+      timer.async_wait(
+        boost::bind(
+          &periodic::rearm,
+          this,
+          as::placeholders::error
+        )
+      );
     }
-    const string u = s.str();
-    assert(m0 == u.size());
-    memcpy(buffer, u.c_str(), m0);
-    seq ++;
   }
 };
 
-class miss_checker
+/// \brief A socket of the receiver, with the state of its current sender.
+struct listener
 {
-  set<uint32_t> seen;
-  const nat m;
-  uint64_t duplicates, missing, original;
+  typedef boost::shared_ptr<listener> ptr;
 
-public:
-  struct result
+  int fd;
+  nat index, worker;    // Position among the sockets, and worker thread with --rx-workers
+  udp::endpoint local, last_remote;
+  packet_receiver::ptr rx;
+  flight_recorder::ptr recorder;
+  bool have_drops;
+  uint32_t socket_drops, socket_drops_at_reset;
+  delivery delivered;   // With --incoming-cpu
+
+  explicit listener(const udp::endpoint& local_) :
+    fd(-1),
+    index(0),
+    worker(0),
+    local(local_),
+    have_drops(false),
+    socket_drops(0),
+    socket_drops_at_reset(0)
   {
-    bool is_duplicate;
-    bool some_missing;
-    nat first_missing, last_missing;
+    fd = socket(local.protocol().family(), SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) throw runtime_error(string("Cannot create socket: ") + strerror(errno));
+    if(bind(fd, local.data(), local.size()))
+    {
+      const int e = errno;
+      close(fd);
+      stringstream u;
+      u << "Cannot bind to " << local << ": " << strerror(e);
+      throw runtime_error(u.str());
+    }
+  }
 
-    result() : is_duplicate(false), some_missing(false), first_missing(0), last_missing(0) { }
-  };
+  ~listener() { close(fd); }
 
-  miss_checker(nat m_) : m(m_),  duplicates(0), missing(0), original(0) { }
+  /// Return the datagrams dropped by the socket since the current sender started.
+  uint32_t dropped() const { return socket_drops - socket_drops_at_reset; }
+};
+
+/// \brief A thread checking and logging the packets of some of the sockets of
+/// the receiver, with --rx-workers.
+/// The receiving thread reads and timestamps packets straight into the ring of
+/// the worker that owns their socket, so that the packets of a sender are
+/// processed in order by a single thread.
+struct rx_worker
+{
+  typedef boost::shared_ptr<rx_worker> ptr;
+
+  packet_ring ring;
+  std::mutex busy;               // Held while processing, so that the receiving thread can read or reset receivers
+  std::mutex idle_mutex;
+  std::condition_variable wake;
+  atomic<bool> sleeping, stopping;
+  atomic<uint64_t> accepted;     // Packets counted by throughput trials
+  uint64_t processed, bytes;
+  uint64_t full;                 // Batches cut short by a full ring, counted by the receiving thread
+  histogram occupancy;           // Ring occupancy at each batch
+  perf_sample usage;             // With --perf-counters, when stopped
+  thread worker;
+#if UDPTOOL_STAGE_TIMERS
+  stage_accounting stages;                // When stopped
+  const stage_accounting *live_stages;    // Of the running worker, only read while holding busy
+#endif
 
-  void remove(result& r)
+  explicit rx_worker(size_t slot_size) :
+    ring(rx_worker_ring, slot_size),
+    sleeping(false),
+    stopping(false),
+    accepted(0),
+    processed(0),
+    bytes(0),
+    full(0)
   {
-    set<nat>::iterator it = seen.begin();
-    if(seen.size() >= 2)
-    {
-      uint32_t s0 = *(it ++),
-               s1 = *it;
-      nat num_missing = s1 - s0 - 1;
-      if(num_missing > 0)
-      {
-        missing += num_missing;
-        r.some_missing = true;
-        r.first_missing = s0 + 1;
-        r.last_missing = s1 - 1;
-      }
-    }
-    seen.erase(seen.begin());
+#if UDPTOOL_STAGE_TIMERS
+    live_stages = NULL;
+#endif
   }
 
-  result add(nat seq)
+  /// Wake the worker up if it sleeps waiting for packets.
+  void notify()
   {
-    result r;
-
-    if(seen.find(seq) == seen.end())
+    atomic_thread_fence(memory_order_seq_cst);
+    if(sleeping)
     {
-      original ++;
-      if(seen.size() == m) remove(r);
-      seen.insert(seq);
+      lock_guard<std::mutex> lock(idle_mutex);
+      wake.notify_one();
     }
-    else
-    {
-      duplicates ++;
-      r.is_duplicate = true;
-    }
-    return r;
   }
-
-  uint64_t get_duplicates() const { return duplicates; }
-  uint64_t get_missing()    const { return missing; }
-  uint64_t get_original()   const { return original; }
 };
 
-class packet_receiver
+/// \brief Receive packets on one or more sockets.
+///
+/// The sockets are plain descriptors registered on an epoll instance, itself
+/// waited upon by the io_service, so that a wakeup serves all ready sockets
+/// instead of one per socket, and the io_service never sees the sockets.  Each
+/// wakeup reads up to receive_batch datagrams from each of up to
+/// epoll_batch ready sockets.  Each socket has its own reception statistics
+/// and log, reset when its sender changes; the running bandwidth is that of
+/// all sockets.  With --rx-workers, packets are checked and logged by worker
+/// threads, each serving the sockets whose index modulo the number of workers
+/// is its own.
+class receiver
 {
-  ofstream log; 
-  uint64_t seq_min, seq_max, seq_last, out_of_order, count, decodable_count,
-           byte_count, bad_checksum, truncated, total_errors, total_erroneous;
-  int64_t t_first, t_last;
-  rtclock clk;
-  miss_checker mc;
-
-public:
-  typedef boost::shared_ptr<packet_receiver> ptr;
-
-  packet_receiver(const string& log_file, nat miss_window) :
-    log(log_file), seq_min(0), seq_max(0), seq_last(0), out_of_order(0),
-    count(0), decodable_count(0), byte_count(0), bad_checksum(0), truncated(0),
-    total_errors(0), total_erroneous(0), mc(miss_window)
+  as::io_service& io;
+  int epoll_fd;
+  as::posix::stream_descriptor epoll_descriptor;
+  vector<struct epoll_event> events;
+  vector<listener::ptr> listeners;
+  vector<rx_worker::ptr> workers;
+  std::mutex pcap_mutex;       // Serializes captures from the workers
+  vector<char> buf;
+  link_statistic::ptr stat;
+#if UDPTOOL_STAGE_TIMERS
+  uint64_t t_handled;  // Cycle count at the end of the last wakeup
+#endif
+  bool batch_full;     // Whether the last wakeup left packets in the sockets
+  nat received;
+  uint64_t received_bytes;
+  perf_counters::ptr perf; // Of the receiving thread, opened when it starts receiving
+  delivery delivered, recent; // Of the receiving thread, overall and since it was last placed
+  udp::endpoint remote;
+  pcap_writer::ptr pcap;
+  char control[CMSG_SPACE(sizeof(uint32_t))];
+  udp_snmp snmp0;
+  uint64_t trial_received, trial_origin;
+  boost::shared_ptr<control_server> control_channel;
+  periodic summary, detailed, placement;
+
+  static int create_epoll()
   {
-    cout << "Logging to " << log_file << endl;
-    log << "t_rx size status seq t_tx errors" << endl;
+    const int fd = epoll_create1(EPOLL_CLOEXEC);
+    if(fd < 0) throw runtime_error(string("Cannot create epoll instance: ") + strerror(errno));
+    return fd;
   }
 
-  virtual ~packet_receiver() { } 
-
-  void receive(const char *buffer, const size_t m0)
+  /// Raise the soft limit of open files to fit a socket and a log per endpoint.
+  static void raise_file_limit(size_t endpoints)
   {
-    const int64_t t_rx = clk.get();
-    string status = "ok";
-    uint32_t seq = 0;
-    uint64_t t_tx = 0;
-    uint32_t errors = 0;
+    struct rlimit rl;
+    const rlim_t needed = 2 * endpoints + reserved_files;
+    if(getrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur >= needed) return;
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? needed : min(needed, rl.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur < needed)
+      cout << "Open files are limited to " << rl.rlim_cur << ", too few for a socket and a log per port" << endl;
+  }
 
-    const string u(buffer, m0);
-    size_t m = m0;
-    stringstream s(u, ios_base::in);
-     
-    do
+public:
+  receiver(as::io_service& io_) :
+    io(io_),
+    epoll_fd(create_epoll()),
+    epoll_descriptor(io, epoll_fd),
+    events(epoll_batch),
+    buf(opt.rx_buf_size),
+    batch_full(false),
+    received(0),
+    received_bytes(0),
+    snmp0(udp_snmp::read()),
+    trial_received(0),
+    trial_origin(0),
+    summary(io, opt.summary_every, boost::bind(&receiver::display_summary, this)),
+    detailed(io, opt.detailed_every, boost::bind(&receiver::display_detailed, this)),
+    placement(io, opt.follow_incoming_cpu ? 1.0 : 0, boost::bind(&receiver::follow_incoming_cpu, this))
+  {
+#if UDPTOOL_STAGE_TIMERS
+    t_handled = 0;
+#endif
+    const size_t endpoints = opt.s_ips.size() * opt.ports.ports.size();
+    raise_file_limit(endpoints);
+    for(size_t i = 0; i < opt.s_ips.size(); i ++)
     {
-      if(m0 < sizeof(packet_header))
+      const as::ip::address address = as::ip::address::from_string(opt.s_ips[i]);
+      for(size_t j = 0; j < opt.ports.ports.size(); j ++)
       {
-        status = "short";
-        break;
+        listener::ptr l(new listener(udp::endpoint(address, opt.ports.ports[j])));
+        struct epoll_event e;
+        memset(&e, 0, sizeof(e));
+        e.events = EPOLLIN;
+        e.data.u32 = listeners.size();
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, l->fd, &e)) throw runtime_error(string("Cannot watch socket: ") + strerror(errno));
+        l->index = listeners.size();
+        listeners.push_back(l);
       }
+    }
 
-      if(!count)
+    if(listeners.size() == 1) cout << "Listening on " << opt.ports.ports[0] << endl;
+    else
+    {
+      cout << "Listening on " << listeners.size() << " sockets, port" << (opt.ports.ports.size() > 1 ? "s " : " ")
+           << opt.ports << " of";
+      for(size_t i = 0; i < opt.s_ips.size(); i ++) cout << " " << opt.s_ips[i];
+      cout << endl;
+    }
+    if(!opt.pcap_file.empty())
+    {
+      cout << "Saving " << (opt.pcap_anomalous ? "damaged" : "all") << " packets to " << opt.pcap_file << endl;
+      pcap = pcap_writer::ptr(new pcap_writer(opt.pcap_file, opt.pcap_snaplen));
+    }
+    for(size_t k = 0; k < listeners.size(); k ++)
+    {
+      const int fd = listeners[k]->fd;
+      set_no_check(fd);
+      set_buffer_size(fd, k == 0);
+      enable_drop_counter(fd, k == 0);
+    }
+    if(opt.control_port > 0)
+    {
+      cout << "Accepting control connections on TCP port " << opt.control_port << endl;
+      control_channel.reset(new control_server(io, as::ip::tcp::endpoint(as::ip::address::from_string(opt.s_ip), opt.control_port),
+                                       boost::bind(&receiver::control_command, this, _1)));
+    }
+    if(opt.rx_workers > 0)
+    {
+      // Workers are started before the receiving thread is pinned, and keep the default placement
+      const nat n = min<size_t>(opt.rx_workers, listeners.size());
+      cout << "Checking packets in " << n << " worker thread" << (n > 1 ? "s" : "") << endl;
+      for(size_t k = 0; k < listeners.size(); k ++) listeners[k]->worker = k % n;
+      for(nat i = 0; i < n; i ++)
       {
-        t_first = t_rx;
+        rx_worker::ptr w(new rx_worker(opt.rx_buf_size));
+        w->worker = thread(&receiver::run_worker, this, w.get());
+        workers.push_back(w);
       }
-      t_last = t_rx;
+    }
+    if(!opt.low_latency) setup_receive();
+  }
 
-      try
-      {
-        packet_header ph(s, m);
+  /// Return the number of packets received.
+  nat get_received() const { return received; }
 
-        if(!ph.checksum_valid())
-        {
-          status = "bad";
-          bad_checksum ++;
-          break;
-        }
+  /// Return the number of bytes received.
+  uint64_t get_received_bytes() const { return received_bytes; }
 
-        seq = ph.sequence;
-        if(!count || seq < seq_min) seq_min = seq;
-        if(!count || seq > seq_max) seq_max = seq;
-        if(count && seq < seq_last)
-        {
-          status = "ooo";
-          out_of_order ++;
-        }
-        seq_last = seq;
-        miss_checker::result r = mc.add(seq);
-        if(r.is_duplicate) status += "-dup";
-        if(r.some_missing)
-        {
-          log << "# missing " << (r.last_missing - r.first_missing + 1) << " " << r.first_missing << " " << r.last_missing << "\n";
-        }
+  void display_residual_statistics(const listener& l)
+  {
+    if(stat && l.rx)
+    {
+      if(listeners.size() == 1) cout << "Finally: " << *stat << endl;
+      else cout << "Finally on " << l.local << ":" << endl;
+      cout << "  Remote address: .......................... " << l.last_remote << endl;
+      cout << "  Local address: ........................... " << l.local << endl;
+      cout << *l.rx << endl;
+      if(l.recorder) cout << "  " << *l.recorder << endl;
+      if(opt.incoming_cpu) cout << "  Delivered by ............................. " << l.delivered << endl;
+      if(l.have_drops)
+      {
+        // SO_RXQ_OVFL counts all datagrams dropped by the socket, decodable or not
+        const uint64_t missing = l.rx->get_missing(),
+                       dropped = l.dropped();
+        cout <<
+          "  Dropped at local socket .................. " << dropped                             << " pk\n"
+          "  Lost in transit .......................... " << (missing > dropped ? missing - dropped : 0) << " pk" << endl;
+      }
+    }
+  }
 
-        t_tx = ph.timestamp;
-        wprng w(ph.check);
+  /// Display which CPUs and NAPI instances delivered the packets of each
+  /// socket, since its sender started, and of the receiving thread.
+  void display_delivery()
+  {
+    if(!opt.incoming_cpu) return;
+    cout << "Delivery:";
+    for(size_t k = 0; k < listeners.size(); k ++)
+    {
+      const listener& l = *listeners[k];
+      if(!l.rx) continue;
+      stringstream local;
+      local << l.local;
+      cout << "\n  " << left << setw(22) << local.str() << right << l.delivered;
+    }
+    cout << "\n  Receiving thread, now on CPU " << sched_getcpu() << ": " << delivered << endl;
+  }
 
-        if(ph.size != m)
-        {
-          truncated ++;
-          status += "trunc";
-          break;
-        }
-        
-        decodable_count ++;
+  /// Move the receiving thread to the CPU that delivered most of its packets
+  /// lately, for --follow-incoming-cpu.
+  void follow_incoming_cpu()
+  {
+    uint64_t n;
+    const int cpu = recent.busiest(n);
+    if(cpu < 0 || recent.get_packets() < follow_min_packets || 2 * n <= recent.get_packets()) return;
 
-        for(nat i = 0; i < m; i ++)
-        {
-          uint8_t expected_byte, received_byte;
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1 && CPU_ISSET(cpu, &set))
+    {
+      recent.clear();
+      return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(sched_setaffinity(0, sizeof(set), &set))
+      cout << "Cannot move the receiving thread to CPU " << cpu << ": " << strerror(errno) << endl;
+    else
+      cout << "Moved the receiving thread to CPU " << cpu << ", which delivered " << fixed << setprecision(1)
+           << 100.0 * n / recent.get_packets() << "% of its last " << recent.get_packets() << " packets" << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    recent.clear();
+  }
 
-          expected_byte = w.get();
-          received_byte = s.get();
+  /// Display a line of statistics per socket that received packets, and their sum.
+  void display_ports()
+  {
+    cout << "Ports:\n  " << left << setw(22) << "Local" << setw(22) << "Remote" << right
+         << setw(12) << "Packets" << setw(14) << "Bytes" << setw(10) << "Lost" << setw(10) << "Dup"
+         << setw(10) << "OOO" << setw(10) << "Damaged" << setw(10) << "Dropped";
+    uint64_t packets = 0, bytes = 0, lost = 0, dup = 0, ooo = 0, damaged = 0, dropped = 0;
+    nat active = 0;
+    for(size_t k = 0; k < listeners.size(); k ++)
+    {
+      const listener& l = *listeners[k];
+      if(!l.rx) continue;
+      const packet_receiver& rx = *l.rx;
+      active ++;
+      packets += rx.get_count();
+      bytes += rx.get_bytes();
+      lost += rx.get_missing();
+      dup += rx.get_duplicates();
+      ooo += rx.get_out_of_order();
+      damaged += rx.get_damaged();
+      dropped += l.dropped();
+      stringstream local, remote;
+      local << l.local;
+      remote << l.last_remote;
+      cout << "\n  " << left << setw(22) << local.str() << setw(22) << remote.str() << right
+           << setw(12) << rx.get_count() << setw(14) << rx.get_bytes() << setw(10) << rx.get_missing()
+           << setw(10) << rx.get_duplicates() << setw(10) << rx.get_out_of_order() << setw(10) << rx.get_damaged()
+           << setw(10) << l.dropped();
+    }
+    stringstream all;
+    all << active << " of " << listeners.size() << " sockets";
+    cout << "\n  " << left << setw(44) << all.str() << right
+         << setw(12) << packets << setw(14) << bytes << setw(10) << lost << setw(10) << dup
+         << setw(10) << ooo << setw(10) << damaged << setw(10) << dropped << endl;
+  }
 
-          if(expected_byte != received_byte) errors ++;
-        }
-        if(errors > 0)
-        {
-          total_erroneous ++;
-          total_errors += errors;
-        }
-      }
-      catch(packet_header::encoding_error& e)
+  ~receiver()
+  {
+    stop_workers();
+    if(listeners.size() == 1) display_residual_statistics(*listeners[0]);
+    else if(stat)
+    {
+      cout << "Finally: " << *stat << endl;
+      display_ports();
+    }
+    if(stat) display_delivery();
+    STAGE_REPORT(cout);
+    if(pcap)
+    {
+      cout << "Saved " << pcap->get_records() << " packets to " << opt.pcap_file;
+      if(pcap->get_waits() > 0) cout << ", waited " << pcap->get_waits() << " times for the disk";
+      cout << endl;
+    }
+    for(size_t i = 0; i < workers.size(); i ++)
+    {
+      const rx_worker& w = *workers[i];
+      cout << "Worker " << i + 1 << ": " << w.processed << " pk, ring occupancy: ";
+      w.occupancy.summary(cout);
+      cout << ", full " << w.full << " times" << endl;
+    }
+    if(perf)
+    {
+      vector<perf_counters::usage> threads;
+      const perf_counters::usage io_thread = { "receive", perf->sample(), received, received_bytes };
+      threads.push_back(io_thread);
+      for(size_t i = 0; i < workers.size(); i ++)
       {
-        status = "bad";
+        const rx_worker& w = *workers[i];
+        const perf_counters::usage worker = { "worker " + to_string(i + 1), w.usage, w.processed, w.bytes };
+        threads.push_back(worker);
       }
+      perf->report(cout, threads);
     }
-    while(false);
-
-    byte_count += m0;
-    count ++;
-
-    log << t_rx << " " << m0 << " " << status << " " << seq << " " << t_tx << " " << errors << "\n";
   }
 
-  void output(ostream& out) const
+  /// Let the workers process the packets queued to them and wait for them.
+  void stop_workers()
   {
-    if(!count)
+    for(size_t i = 0; i < workers.size(); i ++)
     {
-      out << "No packets received";
-      return;
+      rx_worker& w = *workers[i];
+      if(!w.worker.joinable()) continue;
+      w.stopping = true;
+      {
+        lock_guard<std::mutex> lock(w.idle_mutex);
+        w.wake.notify_one();
+      }
+      w.worker.join();
+#if UDPTOOL_STAGE_TIMERS
+      stage_cycles.merge(w.stages);
+#endif
     }
+  }
 
-    double dt = (t_last - t_first)/1e6;
-
-    uint64_t original   = mc.get_original(),
-             missing    = mc.get_missing(),
-             duplicates = mc.get_duplicates(); 
-
-    double p_loss_ratio = double(missing) / double(missing + original);
+  /// Keep the workers from processing packets while receivers are read.
+  vector< unique_lock<std::mutex> > hold_workers()
+  {
+    vector< unique_lock<std::mutex> > locks;
+    for(size_t i = 0; i < workers.size(); i ++) locks.push_back(unique_lock<std::mutex>(workers[i]->busy));
+    return locks;
+  }
 
-    out <<
-      "RX statistics:\n"
-      "  Total packets ............................ " << count                  << " pk\n"
-      "  Total bytes .............................. " << byte_count             << " B\n"
-      "  Time ..................................... " << dt                     << " s\n"
-      "  Packet rate .............................. " << count / dt             << " pk/s\n"
-      "  Bandwidth ................................ " << 8e-6 * byte_count / dt << " Mbit/s\n"
-      "  Packets with bad checksum ................ " << bad_checksum           << " pk\n"
-      "  Truncated packets ........................ " << truncated              << " pk\n"
-      "  Lowest sequence # ........................ " << seq_min                << "\n"
-      "  Highest sequence # ....................... " << seq_max                << "\n"
-      "  Out of order packets ..................... " << out_of_order           << " pk\n"
-      "  Decodable packets ........................ " << decodable_count        << " pk\n"
-      "  Decodable loss ratio ..................... " << p_loss_ratio           << "\n"
-      "  Original decodables ...................... " << original               << " pk\n"
-      "  Lost decodables .......................... " << missing                << " pk\n"
-      "  Duplicate decodables ..................... " << duplicates             << " pk\n"
-      "  Payload byte errors ...................... " << total_errors           << " B\n"
-      "  Decodables with erroneous payloads........ " << total_erroneous        << " pk"
-    ;
-  }
-
-  friend ostream& operator<<(ostream& out, const packet_receiver& self)
-  {
-    self.output(out);
-    return out;
+  /// Return the packets counted by throughput trials.
+  uint64_t get_accepted() const
+  {
+    uint64_t n = trial_received;
+    for(size_t i = 0; i < workers.size(); i ++) n += workers[i]->accepted;
+    return n;
   }
 
-};
+  void set_no_check(int fd)
+  {
+    #if HAVE_SO_NO_CHECK
+      const int off = 0;
+      if(setsockopt(fd, SOL_SOCKET, SO_NO_CHECK, &off, sizeof(off)))
+      {
+        string u = "Cannot set NO_CHECK option: ";
+        u += strerror(errno);
+        throw runtime_error(u);
+      }
+    #endif
+  }
 
-const char *progname = "";
+  void set_buffer_size(int fd, bool verbose)
+  {
+    if(opt.rcvbuf <= 0) return;
 
-using as::ip::udp;
+    // SO_RCVBUFFORCE bypasses net.core.rmem_max but needs CAP_NET_ADMIN
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt.rcvbuf, sizeof(opt.rcvbuf)) &&
+       setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt.rcvbuf, sizeof(opt.rcvbuf)))
+    {
+      string u = "Cannot set SO_RCVBUF: ";
+      u += strerror(errno);
+      throw runtime_error(u);
+    }
 
-boost::system::error_code no_error;
+    if(!verbose) return;
+    int size = 0;
+    socklen_t length = sizeof(size);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &length);
+    cout << "Socket receive buffer is " << size << " bytes (" << opt.rcvbuf << " requested)" << endl;
+  }
 
-class periodic
-{
-  boost::function<void()> method;
-  as::io_service& io;
-  as::deadline_timer timer;
-  boost::posix_time::microseconds interval;
-  bool first;
+  void enable_drop_counter(int fd, bool verbose)
+  {
+    int on = 1;
+    if(setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) && verbose)
+      cout << "Cannot enable SO_RXQ_OVFL, local drops will not be counted: " << strerror(errno) << endl;
+  }
 
-public:
-  periodic(
-      as::io_service& io_,
-      double interval_,
-      boost::function<void()> method_
-    ) :
-    method(method_),
-    io(io_),
-    timer(io),
-    interval(1e6 * interval_),
-    first(true)
+  string control_command(const string& command)
   {
-    if(interval_ > 0)
-      rearm();
+    if(command == "start")
+    {
+      trial_origin = get_accepted();
+      return "ok";
+    }
+    if(command == "stop") return "received " + to_string(get_accepted() - trial_origin);
+    return "error unknown command " + command;
   }
 
-  virtual ~periodic() { }
+  void display_summary()
+  {
+    if(stat) cout << "Received: " << *stat << endl;
+
+    bool have_drops = false;
+    uint64_t dropped = 0;
+    for(size_t k = 0; k < listeners.size(); k ++)
+    {
+      have_drops |= listeners[k]->have_drops;
+      dropped += listeners[k]->dropped();
+    }
 
-  void rearm(boost::system::error_code& error=no_error)
+    const udp_snmp snmp = udp_snmp::read();
+    const bool have_snmp = snmp.valid && snmp0.valid;
+    if(have_drops || have_snmp)
+    {
+      cout << "Drops:";
+      if(have_drops) cout << " socket " << dropped << " pk";
+      if(have_snmp)
+      {
+        cout << (have_drops ? "," : "") <<
+          " UDP RcvbufErrors +" << snmp.rcvbuf_errors - snmp0.rcvbuf_errors <<
+          ", InErrors +" << snmp.in_errors - snmp0.in_errors << " (all sockets)";
+      }
+      cout << endl;
+    }
+  }
+
+  void display_detailed()
   {
-    if(error != as::error::operation_aborted)
+    vector< unique_lock<std::mutex> > held = hold_workers();
+    if(listeners.size() == 1)
     {
-      if(first) first = false;
-      else method();
+      if(listeners[0]->rx) cout << *listeners[0]->rx << endl;
+    }
+    else if(stat) display_ports();
+    display_delivery();
+#if UDPTOOL_STAGE_TIMERS
+    // Held workers do not touch their accounting, which can be merged in
+    stage_accounting all(stage_cycles);
+    for(size_t i = 0; i < workers.size(); i ++) if(workers[i]->live_stages) all.merge(*workers[i]->live_stages);
+    cout << all << endl;
+#endif
+  }
 
-      timer.expires_from_now(interval);
-      timer.async_wait(
+  void setup_receive()
+  {
+    if(opt.count != 0 && received >= opt.count) return;
+
+    // Sockets left with packets are served again once pending handlers have
+    // run, without waiting for the next packet to wake the epoll instance up
+    if(batch_full) io.post(boost::bind(&receiver::handle_readable, this, no_error));
+    else
+    {
+      // Wait for a socket to become readable and read it ourselves, as asio
+      // does not give access to ancillary data
+      epoll_descriptor.async_read_some(
+        as::null_buffers(),
         boost::bind(
-          &periodic::rearm,
+          &receiver::handle_readable,
           this,
           as::placeholders::error
         )
       );
     }
   }
-};
 
-class receiver
-{
-  as::io_service& io;
-  udp::endpoint src;
-  udp::socket socket;
-  boost::system::error_code ec;
-  vector<char> buf;
-  link_statistic::ptr stat;
-  packet_receiver::ptr rx;
-  nat received;
-  udp::endpoint remote, last_remote;
-  periodic summary, detailed;
+  /// Receive one datagram into data and remote, updating the socket drop counter.
+  /// \returns The size of the datagram, or -1 with errno set
+  ssize_t receive_datagram(listener& l, char *data, size_t capacity)
+  {
+    struct iovec iov = { data, capacity };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = remote.data();
+    msg.msg_namelen = remote.capacity();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    STAGE_START(rx_dequeue);
+    const ssize_t size = recvmsg(l.fd, &msg, MSG_DONTWAIT);
+    STAGE_STOP(rx_dequeue);
+    if(size < 0) return size;
+    remote.resize(msg.msg_namelen);
+
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+      if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+      {
+        memcpy(&l.socket_drops, CMSG_DATA(c), sizeof(l.socket_drops));
+        l.have_drops = true;
+      }
+    }
+    return size;
+  }
 
-public:
-  receiver(as::io_service& io_) :
-    io(io_),
-    src(as::ip::address::from_string(opt.s_ip), opt.port),
-    socket(io, src),
-    buf(opt.rx_buf_size),
-    received(0),
-    summary(io, opt.summary_every, boost::bind(&receiver::display_summary, this)),
-    detailed(io, opt.detailed_every, boost::bind(&receiver::display_detailed, this))
+  /// Receive up to receive_batch datagrams from a socket, processed here or
+  /// by its worker.
+  /// \returns The number of datagrams received
+  nat drain(listener& l)
   {
-    cout << "Listening on " << opt.port << endl;
-    set_no_check();
-    setup_receive();
+    const nat n = workers.empty() ? drain_here(l) : drain_to_worker(l);
+    if(n > 0 && opt.incoming_cpu) sample_delivery(l, n);
+    return n;
   }
 
-  void display_residual_statistics()
+  /// Count a batch of packets read from a socket for the CPU and NAPI
+  /// instance that delivered the last of them.
+  void sample_delivery(listener& l, nat n)
   {
-    if(stat && rx)
-    {
-      cout << "Finally: " << *stat << endl;
-      cout << "  Remote address: .......................... " << remote << endl;
-      cout << "  Local address: ........................... " << src << endl;
-      if(rx)   cout << *rx   << endl;
-    }
+    int cpu;
+    uint32_t napi_id;
+    delivery::sample(l.fd, cpu, napi_id);
+    const int here = sched_getcpu();
+    l.delivered.add(cpu, napi_id, here, n);
+    delivered.add(cpu, napi_id, here, n);
+    if(opt.follow_incoming_cpu) recent.add(cpu, napi_id, here, n);
   }
 
-  ~receiver()
+  /// Receive up to receive_batch datagrams from a socket and process them.
+  /// \returns The number of datagrams received
+  nat drain_here(listener& l)
   {
-    display_residual_statistics();
+    nat n = 0;
+    while(n < receive_batch && (opt.count == 0 || received < opt.count))
+    {
+      const ssize_t size = receive_datagram(l, buf.data(), buf.size());
+      if(size >= 0)
+      {
+        process(l, size);
+        n ++;
+      }
+      else if(errno == EINTR) continue;
+      else if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+      else
+      {
+        cout << "Reception error: " << strerror(errno) << endl;
+        break;
+      }
+    }
+    return n;
   }
 
-  void set_no_check()
+  /// Receive up to receive_batch datagrams from a socket into the ring of its
+  /// worker, leaving them in the socket when the ring is full.
+  /// \returns The number of datagrams received
+  nat drain_to_worker(listener& l)
   {
-    #if HAVE_SO_NO_CHECK
-      as::socket_base_extra::no_check ckopt(false);
-      socket.set_option(ckopt, ec);
-      if(ec)
+    rx_worker& w = *workers[l.worker];
+    nat n = 0;
+    while(n < receive_batch && (opt.count == 0 || received < opt.count))
+    {
+      packet_ring::slot *s = w.ring.back();
+      if(!s)
       {
-        string u = "Cannot set NO_CHECK option: ";
-        u += ec.message();
-        throw runtime_error(u);
+        w.full ++;
+        batch_full = true;
+        break;
       }
-    #endif
+      const ssize_t size = receive_datagram(l, s->data, opt.rx_buf_size);
+      if(size >= 0)
+      {
+        dispatch(l, *s, size);
+        w.ring.push();
+        n ++;
+      }
+      else if(errno == EINTR) continue;
+      else if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+      else
+      {
+        cout << "Reception error: " << strerror(errno) << endl;
+        break;
+      }
+    }
+    if(n > 0) w.notify();
+    return n;
   }
 
-  void display_summary()
+  /// Drain the sockets reported ready by the epoll instance, without waiting.
+  /// \returns The number of datagrams received
+  nat drain_ready()
   {
-    if(stat) cout << "Received: " << *stat << endl;
+    const int n = epoll_wait(epoll_fd, events.data(), events.size(), 0);
+    nat total = 0;
+    batch_full = n == int(events.size());
+    for(int k = 0; k < n; k ++)
+    {
+      const nat got = drain(*listeners[events[k].data.u32]);
+      if(got == receive_batch) batch_full = true;
+      total += got;
+    }
+    return total;
   }
 
-  void display_detailed()
+  void reset(listener& l)
   {
-    if(rx) cout << *rx << endl;
+    stringstream log_file;
+    log_file << opt.log_file_prefix << "udp-" << remote << "-to-" << l.local << opt.log_file_suffix;
+    cout << "Logging to " << log_file.str() << endl;
+    l.rx = packet_receiver::create(open_log(log_rx, log_file.str(), l.recorder), opt.miss_window, opt.verify, opt.integrity);
+    l.socket_drops_at_reset = l.socket_drops;
+    l.delivered.clear();
+    if(!stat || listeners.size() == 1) stat = link_statistic::ptr(new link_statistic(opt.avg_window, opt.max_window));
   }
 
-  void setup_receive()
-  {
-    if(opt.count == 0 || received < opt.count)
-      socket.async_receive_from(
-        as::buffer(buf),
-        remote,
-        boost::bind(
-          &receiver::handle_receive_from,
-          this,
-          as::placeholders::error,
-          as::placeholders::bytes_transferred
-        )
-      );
+  void handle_readable(const boost::system::error_code& ec)
+  {
+    if(ec)
+    {
+      cout << "Reception error: " << ec.message() << endl;
+    }
+    else
+    {
+      if(opt.perf_counters && !perf) perf.reset(new perf_counters);
+#if UDPTOOL_STAGE_TIMERS
+      if(batch_full) stage_cycles.add(stage_rx_dispatch, stage_clock() - t_handled);
+#endif
+      // With full worker rings, let the workers run before trying again
+      if(drain_ready() == 0 && batch_full) this_thread::yield();
+#if UDPTOOL_STAGE_TIMERS
+      t_handled = stage_clock();
+#endif
+    }
+    setup_receive();
+  }
+
+  /// Receive packets without ever blocking in the io_service, for the
+  /// --low-latency profile.  The sockets are polled in a non-blocking loop,
+  /// falling back to poll() after spinning idle for --spin microseconds.  A
+  /// single socket is read directly, several through the epoll instance.
+  void run_low_latency()
+  {
+    latency_profile profile(opt.cpu, opt.rt_priority, opt.busy_poll);
+    profile.setup_process();
+    for(size_t k = 0; k < listeners.size(); k ++) profile.setup_socket(listeners[k]->fd);
+    latency_profile::prefault(buf.data(), buf.size());
+    profile.setup_thread();
+    cout << profile << endl;
+    if(opt.perf_counters) perf.reset(new perf_counters);
+
+    listener *single = listeners.size() == 1 ? listeners[0].get() : NULL;
+    const int fd = single ? single->fd : epoll_fd;
+    const int64_t spin = int64_t(1e3 * opt.spin);
+    int64_t t_idle = pacer::now();
+    nat since_timers = 0;
+
+    while(!stop_flag && (opt.count == 0 || received < opt.count))
+    {
+      const nat got = single ? drain(*single) : drain_ready();
+      if(got > 0)
+      {
+        since_timers += got;
+        if(since_timers >= poll_timers_every)
+        {
+          io.poll();
+          since_timers = 0;
+        }
+        t_idle = -1;
+        continue;
+      }
+
+      io.poll();
+      since_timers = 0;
+      const int64_t t_now = pacer::now();
+      if(t_idle < 0) t_idle = t_now;
+      else if(t_now - t_idle >= spin)
+      {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        poll(&pfd, 1, idle_poll_timeout);
+      }
+    }
+  }
+
+  /// Start new statistics and a new log for a socket whose sender changed.
+  void check_sender(listener& l)
+  {
+    if(remote == l.last_remote) return;
+
+    // The worker of the socket must be done with the packets of the previous sender
+    unique_lock<std::mutex> held;
+    if(!workers.empty())
+    {
+      rx_worker& w = *workers[l.worker];
+      while(w.ring.available() > 0)
+      {
+        w.notify();
+        this_thread::yield();
+      }
+      held = unique_lock<std::mutex>(w.busy);
+    }
+
+    display_residual_statistics(l);
+    cout << "Receiving data from " << remote;
+    if(listeners.size() > 1) cout << " on " << l.local;
+    cout << endl;
+    l.last_remote = remote;
+    reset(l);
   }
 
-  void reset()
+  /// Stamp a packet received into the ring of a worker.
+  void dispatch(listener& l, packet_ring::slot& s, size_t size)
   {
-    stringstream log_file;
-    log_file << opt.log_file_prefix << "udp-" << remote << "-to-" << src << opt.log_file_suffix;
-    rx   = packet_receiver::ptr(new packet_receiver(log_file.str(), opt.miss_window));
-    stat = link_statistic::ptr(new link_statistic(opt.avg_window, opt.max_window));
+    check_sender(l);
+    STAGE_START(rx_statistic);
+    stat->add(size);
+    STAGE_STOP(rx_statistic);
+    s.size = size;
+    s.t = l.rx->get_time();
+    s.flow = l.index;
+    if(pcap) clock_gettime(CLOCK_REALTIME, &s.ts);
+    received ++;
+    received_bytes += size;
   }
 
-  void handle_receive_from(const boost::system::error_code& ec, size_t size)
+  /// Process the packets queued to a worker, in the thread of the worker.
+  /// After --spin microseconds without packets, it sleeps until woken up by
+  /// the receiving thread.
+  void run_worker(rx_worker *w)
   {
-    if(ec)
+    perf_counters::ptr perf;
+    if(opt.perf_counters) perf.reset(new perf_counters);
+#if UDPTOOL_STAGE_TIMERS
     {
-      cout << "Reception error: " << ec.message() << endl;
+      lock_guard<std::mutex> lock(w->busy);
+      w->live_stages = &stage_cycles;
     }
-    else
+#endif
+    const int64_t spin = int64_t(1e3 * opt.spin);
+    int64_t t_idle = -1;
+    for(;;)
     {
-      if(remote != last_remote)
+      const size_t available = w->ring.available();
+      if(available == 0)
+      {
+        if(w->stopping && w->ring.available() == 0) break;
+        const int64_t t_now = pacer::now();
+        if(t_idle < 0) t_idle = t_now;
+        if(t_now - t_idle < spin)
+        {
+          this_thread::yield();
+          continue;
+        }
+        unique_lock<std::mutex> lock(w->idle_mutex);
+        w->sleeping = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        w->wake.wait_for(lock, chrono::milliseconds(idle_poll_timeout),
+                         [w] { return w->stopping || w->ring.available() > 0; });
+        w->sleeping = false;
+        continue;
+      }
+      t_idle = -1;
+      w->occupancy.add(available);
+
+      const size_t n = min<size_t>(available, receive_batch);
       {
-        display_residual_statistics();
-        cout << "Receiving data from " << remote << endl;
-        last_remote = remote;
-        reset();
+        lock_guard<std::mutex> lock(w->busy);
+        for(size_t k = 0; k < n; k ++) verify(*w, w->ring.front(k));
       }
-      stat->add(size);
-      rx->receive(buf.data(), size);
-      received ++;
+      w->ring.pop(n);
     }
-    setup_receive();
+#if UDPTOOL_STAGE_TIMERS
+    {
+      lock_guard<std::mutex> lock(w->busy);
+      w->stages = stage_cycles;
+      w->live_stages = NULL;
+    }
+#endif
+    if(perf) w->usage = perf->sample();
+  }
+
+  /// Check, log and capture a packet, in the thread of a worker.
+  void verify(rx_worker& w, const packet_ring::slot& s)
+  {
+    listener& l = *listeners[s.flow];
+    const nat status = l.rx->receive_at(s.data, s.size, s.t);
+    if(!(status & (rx_short | rx_bad | rx_trunc | rx_dup))) w.accepted.store(w.accepted.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if(pcap && (!opt.pcap_anomalous || (status & rx_damaged)))
+    {
+      STAGE_START(rx_capture);
+      lock_guard<std::mutex> lock(pcap_mutex);
+      pcap->write(s.ts, l.last_remote, l.local, s.data, s.size);
+      STAGE_STOP(rx_capture);
+    }
+    w.processed ++;
+    w.bytes += s.size;
+  }
+
+  void process(listener& l, size_t size)
+  {
+    check_sender(l);
+    STAGE_START(rx_statistic);
+    stat->add(size);
+    STAGE_STOP(rx_statistic);
+    struct timespec ts;
+    if(pcap) clock_gettime(CLOCK_REALTIME, &ts);
+    const nat status = l.rx->receive(buf.data(), size);
+    if(!(status & (rx_short | rx_bad | rx_trunc | rx_dup))) trial_received ++;
+    if(pcap && (!opt.pcap_anomalous || (status & rx_damaged)))
+    {
+      STAGE_START(rx_capture);
+      pcap->write(ts, remote, l.local, buf.data(), size);
+      STAGE_STOP(rx_capture);
+    }
+    received ++;
+    received_bytes += size;
   }
 };
 
 class transmitter
 {
   as::io_service& io;
+  udp::endpoint receiver_endpoint, local;
+  boost::shared_ptr<udp::socket> socket;
+  packet_transmitter::ptr tx;
+  flight_recorder::ptr recorder;
+  fast_rng loss_rng;
+  impairment::ptr impair;
+
+  // Packets due at the same time are sent with one sendmmsg() call, with room
+  // for duplicated and released held packets
+  vector< vector<char> > bufs;
+  vector<struct iovec> iov;
+  vector<struct mmsghdr> msgs;
+
+  // With --tx-pipeline, ring between the generator and the sending thread,
+  // with its occupancy when packets are taken and the number of times it ran
+  // dry before the end of a flood
+  packet_ring::ptr pipeline;
+  histogram ring_occupancy;
+  uint64_t ring_underruns;
+#if UDPTOOL_STAGE_TIMERS
+  stage_accounting generator_stages;
+#endif
+  perf_sample generator_usage;
 
 public:
   transmitter(as::io_service& io_) :
-    io(io_)
+    io(io_),
+    loss_rng(opt.seed, rng_stream_loss),
+    bufs(send_batch, vector<char>(max_size)),
+    iov(2 * send_batch + impairment::max_held),
+    msgs(2 * send_batch + impairment::max_held),
+    ring_underruns(0)
   {
   }
 
-  void run()
+  void open()
   {
     if(opt.d_ip.empty()) throw runtime_error("No destination IP");
 
@@ -645,13 +1319,13 @@ public:
     cout << "Resolving " << opt.d_ip << " port " << opt.port << endl;
     udp::resolver resolver(io);
     udp::resolver::query query(udp::v4(), opt.d_ip, to_string(opt.port));
-    udp::endpoint receiver_endpoint = *resolver.resolve(query);
+    receiver_endpoint = *resolver.resolve(query);
 
     cout << "Opening socket" << endl;
     udp::endpoint src(as::ip::address::from_string(opt.s_ip), opt.tx_src_port);
-    udp::socket socket(io, src);
+    socket.reset(new udp::socket(io, src));
 
-    udp::endpoint local = socket.local_endpoint();
+    local = socket->local_endpoint();
     cout << "Socket is bound to " << local << endl;
 
     #if HAVE_SO_NO_CHECK
@@ -660,7 +1334,7 @@ public:
         cout << "Disabling UDP checksumming" << endl;
         as::socket_base_extra::no_check opt(false);
         boost::system::error_code ec;
-        socket.set_option(opt, ec);
+        socket->set_option(opt, ec);
         if(ec)
         {
           string u = "Cannot set NO_CHECK option: ";
@@ -672,111 +1346,788 @@ public:
 
     stringstream log_file;
     log_file << opt.log_file_prefix << "udp-" << local << "-to-" << receiver_endpoint << opt.log_file_suffix;
-    packet_transmitter tx(log_file.str());
+    tx.reset(new packet_transmitter(open_log(log_tx, log_file.str(), recorder), opt.integrity));
+
+    if(opt.impair.active())
+    {
+      cout << opt.impair << endl;
+      impair.reset(new impairment(opt.impair, fast_rng(opt.seed, rng_stream_loss), max_size, opt.impairment_log));
+    }
+
+    if(opt.tx_pipeline > 0) pipeline.reset(new packet_ring(opt.tx_pipeline, max_size));
+  }
+
+  /// Send packets according to a schedule.
+  /// \param count    Stop after this many packets, or 0
+  /// \param duration Stop before packets scheduled at or after this time, in ns, or 0
+  /// \param display  Display the running statistics every second
+  /// \returns The number of packets handed to the transmitter, including those lost by impairment
+  nat flood(schedule& sched, nat count, int64_t duration, link_statistic& stat, histogram& timing_error,
+            bool display)
+  {
+    if(pipeline) return flood_pipelined(sched, count, duration, stat, timing_error, display);
 
     nat sent = 0;
     microsecond_timer::microseconds t_last = microsecond_timer::get();
-    size_t bytes = 0;
+    schedule_entry e = schedule_entry();
+    int64_t t_previous = 0;
+    nat m = 0;
+    auto queue = [this, &m](char *buf, size_t size) { add_message(m, buf, size); };
 
-    link_statistic stat(opt.avg_window, opt.max_window);
+    pacer pace(int64_t(1e3 * opt.spin));
 
-    cout << "Starting flood" << endl;
-    boost::asio::deadline_timer t(io);
+    bool have_entry = sched.next(e) && (duration == 0 || e.t < duration);
+
+    while(!stop_flag && (count == 0 || sent < count) && have_entry)
+    {
+      m = 0;
+      if(impair)
+      {
+        impair->begin_batch();
 
-    vector<distribution::ptr>& sizes = opt.sizes, delays = opt.delays;
-    double bandwidth = opt.bandwidth;
+        // Packets held back by time may be due before the next packet
+        const int64_t t_release = impair->next_release();
+        if(t_release < e.t)
+        {
+          pace.wait_until(t_release);
+          impair->release(pace.elapsed(), queue);
+          send_batch_to(*socket, m);
+          continue;
+        }
+      }
 
-    vector<distribution::ptr>::iterator
-      d_it = delays.begin(),
-      s_it = sizes.begin();
+      const bool on_time = pace.wait_until(e.t);
+      const int64_t t_now = pace.elapsed();
+      if(!on_time) PROBE3(pacing_overrun, tx->get_sequence(), e.t, t_now);
+      nat n = 0;
+      if(impair) impair->release(t_now, queue);
 
-    bool have_delays = d_it != delays.end(),
-         have_sizes  = s_it != sizes.end();
+      do
+      {
+        if(display && sent > 0 && sent % display_every == 0)
+        {
+          microsecond_timer::microseconds t_now = microsecond_timer::get();
+          if(t_now - t_last >= display_delay_microseconds)
+          {
+            cout << "Sent: " << stat << endl;
+            t_last = t_now;
+          }
+        }
+        sent ++;
+
+        const size_t size = e.size;
+        char *buf = bufs[n].data();
+        PROBE4(transmit, tx->get_sequence(), size, e.t, t_now);
+        tx->transmit(buf, size);
+        timing_error.add(t_now > e.t ? t_now - e.t : 0);
+        if(recorder && opt.flight.delay_spike > 0 && t_now - e.t > 1000 * opt.flight.delay_spike)
+          recorder->trigger("late send");
+
+        STAGE_START(tx_impair);
+        if(impair) impair->apply(buf, size, t_now, queue);
+        else queue(buf, size);
+        STAGE_STOP(tx_impair);
+        n ++;
+
+        if(opt.verbose) cerr << size << " " << 1e-6 * (e.t - t_previous) << endl;
+        t_previous = e.t;
+
+        STAGE_START(tx_statistic);
+        stat.add(size);
+        STAGE_STOP(tx_statistic);
+
+        STAGE_START(tx_schedule);
+        have_entry = (count == 0 || sent < count) && sched.next(e) && (duration == 0 || e.t < duration);
+        STAGE_STOP(tx_schedule);
+      }
+      while(have_entry && n < send_batch && e.t <= t_now);
 
-    if(!have_delays && !have_sizes && bandwidth == 0)
-      throw runtime_error("No delay, size nor bandwidth specified");
+      STAGE_START(tx_send);
+      send_batch_to(*socket, m);
+      STAGE_STOP(tx_send);
+    }
 
-    if((!have_delays || !have_sizes) && bandwidth == 0)
-      throw runtime_error("No bandwidth speicifed");
+    if(impair)
+    {
+      m = 0;
+      impair->begin_batch();
+      impair->flush(queue);
+      send_batch_to(*socket, m);
+    }
+    return sent;
+  }
 
-    if(bandwidth > 0 && have_delays && have_sizes)
-      throw runtime_error("You cannot specify all three of bandwidth, delays and sizes.");
+  /// Same as flood(), with packets built by a generator thread into the ring
+  /// ahead of their scheduled time.  The sending thread waits for due times,
+  /// impairs and sends.  Packets are stamped with their scheduled time: the
+  /// header check seeds the payload and is covered by the CRC, so stamping the
+  /// actual sending time would mean building the packet again.  The late send
+  /// trigger of the flight recorder, which belongs to the generator, fires
+  /// before the next packet it builds.
+  nat flood_pipelined(schedule& sched, nat count, int64_t duration, link_statistic& stat, histogram& timing_error,
+                      bool display)
+  {
+    packet_ring& ring = *pipeline;
+    nat sent = 0;
+    microsecond_timer::microseconds t_last = microsecond_timer::get();
+    int64_t t_previous = 0;
+    nat m = 0;
+    auto queue = [this, &m](char *buf, size_t size) { add_message(m, buf, size); };
 
-    microsecond_timer::microseconds t0 = microsecond_timer::get();
+    pacer pace(int64_t(1e3 * opt.spin));
+    const int64_t t_origin = tx->get_time();
+    atomic<bool> done(false), stopping(false), late(false);
+    exception_ptr error;
 
-    while(!stop_flag && (opt.count == 0 || sent < opt.count))
+    thread generator([&]
     {
-      if(sent > 0 && sent % display_every == 0)
+      perf_counters::ptr perf;
+      try
       {
-        microsecond_timer::microseconds t_now = microsecond_timer::get();
-        if(t_now - t_last >= display_delay_microseconds)
+        if(opt.perf_counters) perf.reset(new perf_counters);
+        if(opt.low_latency) latency_profile::release_helper_thread(opt.cpu);
+        const pacer idle(pace, 0);
+        schedule_entry e = schedule_entry();
+        nat n = 0;
+        while(!stopping && (count == 0 || n < count))
         {
-          cout << "Sent: " << stat << endl;
-          t_last = t_now;
+          STAGE_START(tx_schedule);
+          const bool have_entry = sched.next(e) && (duration == 0 || e.t < duration);
+          STAGE_STOP(tx_schedule);
+          if(!have_entry) break;
+
+          // When the ring is full, the oldest packet is the next one due
+          packet_ring::slot *s;
+          while(!(s = ring.back()) && !stopping)
+          {
+            if(!idle.wait_until(ring.oldest_time())) this_thread::yield();
+          }
+          if(!s) break;
+
+          if(recorder && late.exchange(false)) recorder->trigger("late send");
+          s->size = e.size;
+          s->t = e.t;
+          s->seq = tx->get_sequence();
+          tx->transmit_at(s->data, e.size, t_origin + e.t / 1000);
+          ring.push();
+          n ++;
         }
       }
-      sent ++;
-
-      double delay, delay_avg;
-      size_t size, size_avg;
-
-      if(have_delays)
+      catch(...)
       {
-        delay = (*d_it)->next();
-        delay_avg = (*d_it)->mean();
-        d_it ++;
-        if(d_it == delays.end()) d_it = delays.begin();
+        error = current_exception();
       }
-      else
+#if UDPTOOL_STAGE_TIMERS
+      generator_stages = stage_cycles;
+#endif
+      if(perf) generator_usage += perf->sample();
+      done = true;
+    });
+
+    bool starved = false;
+    while(!stop_flag)
+    {
+      size_t available = ring.available();
+      if(available == 0)
       {
-        delay_avg = delay = default_delay;
+        if(done && ring.available() == 0) break;
+        if(sent > 0 && !starved)
+        {
+          ring_underruns ++;
+          starved = true;
+        }
+        this_thread::yield();
+        continue;
       }
+      starved = false;
+      ring_occupancy.add(available);
 
-      if(have_sizes)
+      m = 0;
+      const packet_ring::slot *s = &ring.front();
+      if(impair)
       {
-        size = (*s_it)->next();
-        size_avg = (*s_it)->mean();
-        s_it ++;
-        if(s_it == sizes.end()) s_it = sizes.begin();
+        impair->begin_batch();
+
+        // Packets held back by time may be due before the next packet
+        const int64_t t_release = impair->next_release();
+        if(t_release < s->t)
+        {
+          pace.wait_until(t_release);
+          impair->release(pace.elapsed(), queue);
+          send_batch_to(*socket, m);
+          continue;
+        }
       }
-      else
+
+      const bool on_time = pace.wait_until(s->t);
+      const int64_t t_now = pace.elapsed();
+      if(!on_time) PROBE3(pacing_overrun, s->seq, s->t, t_now);
+      if(impair) impair->release(t_now, queue);
+
+      // Packets published while waiting can go in the same batch
+      available = ring.available();
+      nat n = 0;
+      do
       {
-        size_avg = size = default_size;
+        if(display && sent > 0 && sent % display_every == 0)
+        {
+          microsecond_timer::microseconds t_now = microsecond_timer::get();
+          if(t_now - t_last >= display_delay_microseconds)
+          {
+            cout << "Sent: " << stat << endl;
+            t_last = t_now;
+          }
+        }
+        sent ++;
+
+        const size_t size = s->size;
+        PROBE4(transmit, s->seq, size, s->t, t_now);
+        timing_error.add(t_now > s->t ? t_now - s->t : 0);
+        if(opt.flight.delay_spike > 0 && t_now - s->t > 1000 * opt.flight.delay_spike) late = true;
+
+        STAGE_START(tx_impair);
+        if(impair) impair->apply(s->data, size, t_now, queue);
+        else queue(s->data, size);
+        STAGE_STOP(tx_impair);
+        n ++;
+
+        if(opt.verbose) cerr << size << " " << 1e-6 * (s->t - t_previous) << endl;
+        t_previous = s->t;
+
+        STAGE_START(tx_statistic);
+        stat.add(size);
+        STAGE_STOP(tx_statistic);
+
+        if(n < available) s = &ring.front(n);
       }
+      while(n < available && n < send_batch && s->t <= t_now);
+
+      STAGE_START(tx_send);
+      send_batch_to(*socket, m);
+      STAGE_STOP(tx_send);
+      ring.pop(n);
+    }
+
+    stopping = true;
+    generator.join();
+    ring.clear();
+#if UDPTOOL_STAGE_TIMERS
+    stage_cycles.merge(generator_stages);
+#endif
+    if(error) rethrow_exception(error);
+
+    if(impair)
+    {
+      m = 0;
+      impair->begin_batch();
+      impair->flush(queue);
+      send_batch_to(*socket, m);
+    }
+    return sent;
+  }
+
+  void run()
+  {
+    open();
+
+    link_statistic stat(opt.avg_window, opt.max_window);
+
+    schedule_source::ptr source;
+    boost::shared_ptr<replay_source> replay;
+    if(!opt.replay_file.empty())
+    {
+      replay.reset(new replay_source(opt.replay_file, opt.replay_speed, max_size));
+      cout << *replay << endl;
+      source = replay;
+    }
+    else if(!opt.scenario_file.empty())
+    {
+      boost::shared_ptr<scenario> sc(new scenario(opt.scenario_file, max_size,
+                                                  fast_rng(opt.seed, rng_stream_schedule)));
+      cout << *sc << endl;
+      source = sc;
+    }
+    else
+    {
+      source = schedule_source::ptr(new cyclic_source(opt.sizes, opt.delays, opt.bandwidth, default_size, default_delay,
+                                                      max_size, fast_rng(opt.seed, rng_stream_schedule)));
+    }
+    schedule sched(source);
+    histogram timing_error;
+
+    set_low_latency();
+    perf_counters::ptr perf;
+    if(opt.perf_counters) perf.reset(new perf_counters);
+
+    cout << "Starting flood" << endl;
+    flood(sched, opt.count, 0, stat, timing_error, true);
+
+    cout << "Total: " << stat << endl;
+    cout << "Send timing error: ";
+    timing_error.summary(cout, 1e3, " us");
+    cout << endl;
+    if(pipeline)
+    {
+      cout << "TX ring of " << pipeline->capacity() << " packets, occupancy: ";
+      ring_occupancy.summary(cout);
+      cout << ", underruns: " << ring_underruns << endl;
+    }
+    if(impair) cout << *impair << endl;
+    if(recorder) cout << *recorder << endl;
+    STAGE_REPORT(cout);
+    if(replay) cout << *replay << endl;
+    if(sched.get_stalls() > 0) cout << "Schedule generator stalls: " << sched.get_stalls() << endl;
+    if(perf) report_usage(*perf, stat);
+  }
+
+  /// Report the usage of the sending thread, and of the generator with --tx-pipeline.
+  void report_usage(const perf_counters& perf, const link_statistic& stat)
+  {
+    vector<perf_counters::usage> threads;
+    const perf_counters::usage sender = { "send", perf.sample(), stat.get_count(), stat.get_total() };
+    threads.push_back(sender);
+    if(pipeline)
+    {
+      const perf_counters::usage generator = { "generate", generator_usage, stat.get_count(), stat.get_total() };
+      threads.push_back(generator);
+    }
+    perf.report(cout, threads);
+  }
+
+  /// Find the highest rate at which each packet size goes through with a loss
+  /// ratio within tolerance, by binary search over timed trials whose losses
+  /// are counted by the receiver.
+  void search_throughput()
+  {
+    open();
+
+    udp::resolver resolver(io);
+    as::ip::tcp::endpoint control_endpoint(resolver.resolve(udp::resolver::query(udp::v4(), opt.d_ip, "0"))->endpoint().address(),
+                                           opt.control_port);
+    cout << "Connecting to the receiver control port " << control_endpoint << endl;
+    control_client control(io, control_endpoint);
 
-      if(!have_delays)
+    const double max_rate = opt.bandwidth > 0 ? opt.bandwidth : default_search_rate,
+                 resolution = search_resolution * max_rate;
+
+    set_low_latency();
+
+    vector< pair<nat, double> > results;
+
+    for(size_t k = 0; k < opt.search_sizes.size() && !stop_flag; k ++)
+    {
+      const nat size = opt.search_sizes[k];
+      double lo = 0, hi = max_rate, rate = max_rate;
+
+      // The first trial is at the maximum rate, then the search bisects
+      while(!stop_flag)
       {
-        delay = 1e3 * double(size_avg) / (1e6/8.0 * bandwidth);
+        const double loss = trial(control, size, rate);
+        cout << "Trial: size " << size << " B, rate " << rate << " Mbit/s, loss ratio " << loss << endl;
+        if(loss <= opt.loss_tolerance) lo = rate;
+        else hi = rate;
+        if(lo == max_rate || hi - lo <= resolution) break;
+        rate = (lo + hi) / 2;
       }
-      else
+      results.push_back(make_pair(size, lo));
+    }
+
+    cout <<
+      "Throughput search (trials of " << opt.trial_duration << " s, loss tolerance " << opt.loss_tolerance << "):\n"
+      "      Size    Throughput          Rate\n"
+      "         B        Mbit/s          pk/s\n";
+    for(size_t k = 0; k < results.size(); k ++)
+    {
+      cout << setw(10) << results[k].first << setw(14) << results[k].second
+           << setw(14) << uint64_t(1e6 / 8 * results[k].second / results[k].first) << "\n";
+    }
+    cout << flush;
+  }
+
+  /// Send many flows, each with its own destination, rate, size and sequence
+  /// numbers, driven by a timing wheel.
+  void run_flows()
+  {
+    flow_table flows;
+    if(!opt.flows_file.empty()) flows.load(opt.flows_file);
+    for(size_t k = 0; k < opt.flow_ranges.size(); k ++) flows.add_range(opt.flow_ranges[k], opt.flow_rate, opt.flow_size);
+    if(flows.flows() == 0) throw runtime_error("No flows");
+    cout << flows << endl;
+
+    vector< boost::shared_ptr<udp::socket> > sockets;
+    for(size_t k = 0; k < flows.source_ports.size(); k ++)
+    {
+      udp::endpoint src(as::ip::address::from_string(opt.s_ip), flows.source_ports[k]);
+      sockets.push_back(boost::shared_ptr<udp::socket>(new udp::socket(io, src)));
+    }
+
+    // Flows start at random phases so that equal rates do not send in bursts
+    const size_t n = flows.flows();
+    timing_wheel wheel(n, flow_tick_ns);
+    fast_rng phase_rng(opt.seed, rng_stream_schedule);
+    for(size_t f = 0; f < n; f ++)
+    {
+      flows.next_t[f] = int64_t(phase_rng.uniform() * flows.gap[f]);
+      wheel.schedule(f, flows.next_t[f]);
+    }
+
+    vector<uint64_t> flow_sent(n, 0);
+    vector<uint32_t> due;
+    due.reserve(n);
+    vector<struct sockaddr_in> addrs(send_batch);
+    link_statistic stat(opt.avg_window, opt.max_window);
+    histogram timing_error;
+    rtclock clk;
+    nat sent = 0;
+    microsecond_timer::microseconds t_last = microsecond_timer::get();
+
+    set_low_latency();
+    perf_counters::ptr perf;
+    if(opt.perf_counters) perf.reset(new perf_counters);
+
+    cout << "Starting flood" << endl;
+    pacer pace(int64_t(1e3 * opt.spin));
+
+    while(!stop_flag && (opt.count == 0 || sent < opt.count))
+    {
+      pace.wait_until(wheel.next_expiry());
+      const int64_t t_now = pace.elapsed();
+      wheel.advance(t_now, [&due](uint32_t f) { due.push_back(f); });
+
+      // Batches are cut when the sending socket changes
+      nat m = 0, batch_socket = 0;
+      for(size_t i = 0; i < due.size(); i ++)
       {
-        if(!have_sizes)
+        const uint32_t f = due[i];
+        if(m > 0 && (m == send_batch || flows.socket[f] != batch_socket))
+        {
+          send_batch_to(*sockets[batch_socket], m);
+          m = 0;
+        }
+        batch_socket = flows.socket[f];
+
+        if(opt.count == 0 || sent < opt.count)
         {
-          size = double(delay_avg) * 1e-3 * (1e6/8.0 * bandwidth);
+          const size_t size = flows.size[f];
+          char *buf = bufs[m].data();
+          if(size >= packet_header::encoded_size) packet_transmitter::encode(buf, size, flows.seq[f], clk.get(), opt.integrity);
+          flows.seq[f] ++;
+          flow_sent[f] ++;
+          sent ++;
+          stat.add(size);
+          timing_error.add(t_now > flows.next_t[f] ? t_now - flows.next_t[f] : 0);
+
+          if(opt.p_loss == 0 || loss_rng.uniform() >= opt.p_loss)
+          {
+            struct sockaddr_in& a = addrs[m];
+            memset(&a, 0, sizeof(a));
+            a.sin_family = AF_INET;
+            a.sin_addr.s_addr = flows.address[f];
+            a.sin_port = htons(flows.port[f]);
+            iov[m].iov_base = buf;
+            iov[m].iov_len = size;
+            memset(&msgs[m], 0, sizeof(msgs[m]));
+            msgs[m].msg_hdr.msg_name = &a;
+            msgs[m].msg_hdr.msg_namelen = sizeof(a);
+            msgs[m].msg_hdr.msg_iov = &iov[m];
+            msgs[m].msg_hdr.msg_iovlen = 1;
+            m ++;
+          }
         }
+
+        flows.next_t[f] += flows.gap[f];
+        wheel.schedule(f, flows.next_t[f]);
       }
+      if(m > 0) send_batch_to(*sockets[batch_socket], m);
+      due.clear();
 
-      if(size <= 0) continue;
+      microsecond_timer::microseconds t = microsecond_timer::get();
+      if(sent > 0 && t - t_last >= display_delay_microseconds)
+      {
+        cout << "Sent: " << stat << endl;
+        t_last = t;
+      }
+    }
 
-      std::vector<char> buf(size);
-      tx.transmit(buf.data(), size);
+    cout << "Total: " << stat << endl;
+    cout << "Send timing error: ";
+    timing_error.summary(cout, 1e3, " us");
+    cout << endl;
 
-      if(delay > 0)
-        t.expires_at(
-          microsecond_timer::as_posix(t0 + sent * delay * 1e3)
-        );
+    const uint64_t least = *min_element(flow_sent.begin(), flow_sent.end()),
+                   most = *max_element(flow_sent.begin(), flow_sent.end());
+    cout << "Packets per flow: min " << least << ", mean " << double(sent) / n << ", max " << most << endl;
+    if(perf) report_usage(*perf, stat);
 
-      if(opt.p_loss == 0 || drand48() >= opt.p_loss)
-        socket.send_to(boost::asio::buffer(buf), receiver_endpoint);
+    if(!opt.flow_stats_file.empty())
+    {
+      ofstream out(opt.flow_stats_file.c_str());
+      out << "flow,address,port,source_port,size,rate,packets,bytes\n";
+      for(size_t f = 0; f < n; f ++)
+      {
+        struct in_addr a;
+        a.s_addr = flows.address[f];
+        out << f << "," << inet_ntoa(a) << "," << flows.port[f] << "," << flows.source_ports[flows.socket[f]] << ","
+            << flows.size[f] << "," << 1e9 / flows.gap[f] << "," << flow_sent[f] << "," << flow_sent[f] * flows.size[f] << "\n";
+      }
+      cout << "Per-flow statistics written to " << opt.flow_stats_file << endl;
+    }
+  }
 
-      if(opt.verbose) cerr << size << " " << delay << endl;
+private:
+  /// Append a packet for the receiver to the batch of m messages.
+  void add_message(nat& m, char *buf, size_t size)
+  {
+    iov[m].iov_base = buf;
+    iov[m].iov_len = size;
+    memset(&msgs[m], 0, sizeof(msgs[m]));
+    msgs[m].msg_hdr.msg_name = receiver_endpoint.data();
+    msgs[m].msg_hdr.msg_namelen = receiver_endpoint.size();
+    msgs[m].msg_hdr.msg_iov = &iov[m];
+    msgs[m].msg_hdr.msg_iovlen = 1;
+    m ++;
+  }
 
-      bytes += size;
-      stat.add(size);
+  void send_batch_to(udp::socket& s, nat m)
+  {
+    for(nat i = 0; i < m; )
+    {
+      int r = sendmmsg(s.native_handle(), &msgs[i], m - i, 0);
+      if(r < 0)
+      {
+        if(errno == EINTR) continue;
+        string u = "Cannot send: ";
+        u += strerror(errno);
+        throw runtime_error(u);
+      }
+      i += r;
+    }
+  }
 
-      if(delay > 0) t.wait();
+  void set_low_latency()
+  {
+    // Helper threads are running by now, and do not inherit the pinning
+    if(opt.low_latency)
+    {
+      latency_profile profile(opt.cpu, opt.rt_priority, 0);
+      profile.setup_process();
+      profile.setup_thread();
+      cout << profile << endl;
     }
-    cout << "Total: " << stat << endl;
+  }
+
+  /// Run one trial and return its loss ratio.
+  double trial(control_client& control, nat size, double rate)
+  {
+    vector<distribution::ptr> sizes(1, distribution::ptr(new dirac(size)));
+    schedule sched(schedule_source::ptr(new cyclic_source(sizes, vector<distribution::ptr>(), rate, default_size,
+                                                          default_delay, max_size, fast_rng(opt.seed, rng_stream_schedule))));
+    link_statistic stat(opt.avg_window, opt.max_window);
+    histogram timing_error;
+
+    control.call("start");
+    const nat sent = flood(sched, 0, int64_t(1e9 * opt.trial_duration), stat, timing_error, false);
+
+    // Let packets in flight arrive before closing the trial
+    usleep(trial_drain_microseconds);
+    const string reply = control.call("stop");
+
+    stringstream in(reply);
+    string word;
+    uint64_t received = 0;
+    in >> word >> received;
+    if(in.fail() || word != "received") throw runtime_error("Unexpected reply from receiver: " + reply);
+
+    return sent > received ? double(sent - received) / sent : 0;
+  }
+};
+
+/// \brief Synthetic transmission and reception over the loopback interface,
+/// the training workload of profile-guided builds.
+///
+/// Each case floods a receiver running in another thread with packets of one
+/// size as fast as possible, through the same paths as --tx and --rx.  The cost
+/// of each side is its thread CPU time per packet, which does not depend on how
+/// the two threads share the CPUs.  The usual output of both sides is
+/// discarded and the results are written as JSON to the standard output.
+class loopback_bench
+{
+  struct result
+  {
+    nat size;
+    string verify;
+    payload_integrity integrity;
+    nat sent, received;
+    double tx_seconds, tx_cpu_seconds, rx_cpu_seconds;
+    uint64_t tx_bytes, rx_bytes;
+    perf_sample tx_usage, rx_usage; // With --perf-counters
+  };
+
+  /// Discard everything written to a stream until destruction.
+  class silence
+  {
+    struct null_buffer : public streambuf
+    {
+      int overflow(int c) { return c; }
+    };
+
+    ostream& out;
+    null_buffer null;
+    streambuf *saved;
+
+  public:
+    explicit silence(ostream& out_) : out(out_), saved(out_.rdbuf(&null)) { }
+    ~silence() { out.rdbuf(saved); }
+  };
+
+  const nat packets;
+  string log_dir;
+  vector<result> results;
+
+  static double thread_cpu_seconds()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+  }
+
+  void run_case(nat size, const verify_mode& verify, payload_integrity integrity)
+  {
+    opt.verify = verify;
+    opt.integrity = integrity;
+
+    result r;
+    r.size = size;
+    r.verify = verify.name();
+    r.integrity = integrity;
+
+    silence quiet(cout);
+    as::io_service tx_io, rx_io;
+    opt.log_file_prefix = log_dir + "/tx-";
+    transmitter tx(tx_io);
+    tx.open();
+
+    opt.log_file_prefix = log_dir + "/rx-";
+    receiver rx(rx_io);
+    r.rx_cpu_seconds = 0;
+    thread rx_thread([&rx_io, &r]
+    {
+      perf_counters::ptr perf;
+      if(opt.perf_counters) perf.reset(new perf_counters);
+      const double t0 = thread_cpu_seconds();
+      rx_io.run();
+      r.rx_cpu_seconds = thread_cpu_seconds() - t0;
+      if(perf) r.rx_usage = perf->sample();
+    });
+
+    vector<distribution::ptr> sizes(1, distribution::ptr(new dirac(size))),
+                              delays(1, distribution::ptr(new dirac(0)));
+    schedule sched(schedule_source::ptr(new cyclic_source(sizes, delays, 0, default_size, default_delay, max_size,
+                                                          fast_rng(opt.seed, rng_stream_schedule))));
+    link_statistic stat(opt.avg_window, opt.max_window);
+    histogram timing_error;
+
+    perf_counters::ptr perf;
+    if(opt.perf_counters) perf.reset(new perf_counters);
+    const int64_t t0 = pacer::now();
+    const double cpu0 = thread_cpu_seconds();
+    r.sent = tx.flood(sched, packets, 0, stat, timing_error, false);
+    r.tx_cpu_seconds = thread_cpu_seconds() - cpu0;
+    r.tx_seconds = 1e-9 * (pacer::now() - t0);
+    if(perf) r.tx_usage = perf->sample();
+    r.tx_bytes = stat.get_total();
+
+    usleep(trial_drain_microseconds);
+    rx_io.stop();
+    rx_thread.join();
+    r.received = rx.get_received();
+    r.rx_bytes = rx.get_received_bytes();
+    results.push_back(r);
+  }
+
+  void remove_logs()
+  {
+    DIR *d = opendir(log_dir.c_str());
+    if(!d) return;
+    while(struct dirent *e = readdir(d))
+    {
+      if(e->d_name[0] != '.') unlink((log_dir + "/" + e->d_name).c_str());
+    }
+    closedir(d);
+    rmdir(log_dir.c_str());
+  }
+
+public:
+  /// \param packets Packets sent per case
+  explicit loopback_bench(nat packets_) : packets(packets_)
+  {
+    char dir[] = "/tmp/udptool-bench-XXXXXX";
+    if(!mkdtemp(dir)) throw runtime_error(string("Cannot create a directory for the benchmark logs: ") + strerror(errno));
+    log_dir = dir;
+  }
+
+  ~loopback_bench() { remove_logs(); }
+
+  void run()
+  {
+    opt.s_ip = "127.0.0.1";
+    opt.s_ips.assign(1, opt.s_ip);
+    opt.ports = port_list(opt.port);
+    opt.d_ip = "127.0.0.1";
+    opt.count = 0;
+    opt.low_latency = false;
+    if(opt.rcvbuf <= 0) opt.rcvbuf = bench_rcvbuf;
+
+    const verify_mode modes[] = { verify_mode(verify_mode::none), verify_mode(verify_mode::header), verify_mode(verify_mode::full) };
+    for(size_t k = 0; k < sizeof(bench_sizes) / sizeof(*bench_sizes) && !stop_flag; k ++)
+    {
+      cerr << "Benchmarking " << bench_sizes[k] << " B packets" << endl;
+      for(size_t j = 0; j < sizeof(modes) / sizeof(*modes) && !stop_flag; j ++)
+        run_case(bench_sizes[k], modes[j], integrity_pattern);
+      if(!stop_flag) run_case(bench_sizes[k], verify_mode(verify_mode::full), integrity_crc32c);
+    }
+  }
+
+  friend ostream& operator<<(ostream& out, const loopback_bench& self)
+  {
+    double tx_log = 0, rx_log = 0;
+    out << fixed << setprecision(1) <<
+      "{\n"
+      "  \"benchmark\": \"loopback\",\n"
+      "  \"compiler\": \"" << __VERSION__ << "\",\n"
+      "  \"packets\": " << self.packets << ",\n"
+      "  \"cases\":\n"
+      "  [\n";
+    for(size_t k = 0; k < self.results.size(); k ++)
+    {
+      const result& r = self.results[k];
+      const double tx_ns = r.sent ? 1e9 * r.tx_cpu_seconds / r.sent : 0,
+                   rx_ns = r.received ? 1e9 * r.rx_cpu_seconds / r.received : 0;
+      tx_log += log(tx_ns);
+      rx_log += log(rx_ns);
+      out <<
+        "    { \"size\": " << r.size << ", \"verify\": \"" << r.verify << "\", \"integrity\": \""
+        << payload_integrity_name(r.integrity) << "\", \"sent\": " << r.sent << ", \"received\": " << r.received
+        << ", \"tx_packets_per_second\": " << (r.tx_seconds > 0 ? r.sent / r.tx_seconds : 0)
+        << ", \"tx_ns_per_packet\": " << tx_ns << ", \"rx_ns_per_packet\": " << rx_ns;
+      if(opt.perf_counters)
+      {
+        out << ", ";
+        r.tx_usage.write_json(out, "tx_", r.sent, r.tx_bytes);
+        out << ", ";
+        r.rx_usage.write_json(out, "rx_", r.received, r.rx_bytes);
+      }
+      out << " }" << (k + 1 < self.results.size() ? "," : "") << "\n";
+    }
+    const size_t n = self.results.size();
+    out <<
+      "  ],\n"
+      "  \"tx_ns_per_packet_geomean\": " << (n ? exp(tx_log / n) : 0) << ",\n"
+      "  \"rx_ns_per_packet_geomean\": " << (n ? exp(rx_log / n) : 0) << "\n"
+      "}";
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+    return out;
   }
 };
 
@@ -799,23 +2150,66 @@ int main(int argc, char* argv[])
     ("help,h",                                                    "Display this information")
     ("tx",              po::bool_switch(&opt.transmit),           "Transmit packets")
     ("rx",              po::bool_switch(&opt.receive),            "Receive packets")
-    ("sip",             po::value<string>(&opt.s_ip),             "Source IP to bind to")
+    ("sip",             po::value< vector<string> >(&opt.s_ips),  "Source IP to bind to; with --rx, may be given several times")
     ("dip",             po::value<string>(&opt.d_ip),             "Destination IP to transmit to")
-    ("port",            po::value<nat>(&opt.port),                "Target port (default 33333)")
+    ("port",            po::value<port_list>(&opt.ports),         "Target port (default 33333); with --rx, ports and ranges to listen on, e.g. 33333,40000-40999")
     ("size",            po::value< vector<distribution::ptr> >(), "Add a packet size distribution")
     ("delay",           po::value< vector<distribution::ptr> >(), "Add a packet transmission delay distribution (ms)")
     ("bandwidth",       po::value<double>(&opt.bandwidth),        "Adjust delay or packet size to bandwidth (Mbit/s)") 
+    ("scenario",        po::value<string>(&opt.scenario_file),    "Read a multi-phase traffic scenario from a file")
+    ("replay",          po::value<string>(&opt.replay_file),      "Replay the sizes and timing of a .txl log or pcap capture")
+    ("replay-speed",    po::value<double>(&opt.replay_speed),     "Divide replayed inter-packet gaps by this factor (default 1)")
+    ("spin",            po::value<double>(&opt.spin),             "Spin for this many microseconds before each send time, or when idle with --low-latency (default 0, 50 when replaying, 1000 with --low-latency)")
     ("count",           po::value<nat>(&opt.count),               "Number of packets to send, or 0 for no limit)")
+    ("tx-pipeline",     po::value<nat>(&opt.tx_pipeline),         "Build packets ahead of time in another thread, into a ring of this many packets of 64 kB (default 0, off)")
     ("verbose",         po::bool_switch(&opt.verbose),            "Display each packet as it is sent")
     ("summary-every",   po::value<double>(&opt.summary_every),    "Display summary statistics every so many seconds")
     ("detailed-every",  po::value<double>(&opt.detailed_every),   "Display detailed statistics every so many seconds")
     ("log-file-prefix", po::value<string>(&opt.log_file_prefix),  "Prefix for log file names")
     ("log-file-suffix", po::value<string>(&opt.log_file_suffix),  "Suffix for log file names")
+    ("log-format",      po::value<packet_log::format>(&opt.log_format), "Log format: text (default) or compressed")
+    ("flight-recorder", po::value<nat>(&opt.flight.before),       "Keep this many log records in memory and dump them around anomalies (default 0, off)")
+    ("flight-after",    po::value<nat>(&opt.flight.after),        "Records to keep recording after a flight recorder trigger (default 1000)")
+    ("flight-loss-burst", po::value<nat>(&opt.flight.loss_burst), "Trigger the flight recorder on this many consecutive lost packets, or 0 (default 10)")
+    ("flight-delay-spike", po::value<int64_t>(&opt.flight.delay_spike), "Trigger the flight recorder on delays this many microseconds above the lowest, or sends this late, or 0 (default 10000)")
+    ("log-mode",        po::value<log_mode>(&opt.log_granularity), "Log every packet (packets, the default) or aggregates per wall-clock bin of S seconds (bins:S)")
+    ("decode-log",      po::value<string>(&opt.decode_log_file),  "Write a compressed log to the standard output in the text format")
     ("p-loss",          po::value<double>(&opt.p_loss),           "Simulated packet loss probability")
+    ("burst-loss",      po::value<gilbert_elliott>(&opt.impair.loss), "Simulated Gilbert-Elliott loss P,R[,LB[,LG]]: P good to bad, R bad to good, loss probability LB when bad (default 1), LG when good (default 0)")
+    ("reorder",         po::value<reorder_model>(&opt.impair.reorder), "Hold back packets with probability P by N packets (P,N) or T microseconds (P,Tus)")
+    ("duplicate",       po::value<double>(&opt.impair.p_duplicate), "Duplicate packets with this probability")
+    ("corrupt",         po::value<corruption_model>(&opt.impair.corrupt), "Flip B payload bits (default 1) of packets with probability P (P[,B])")
+    ("impairment-log",  po::value<string>(&opt.impairment_log),   "Log the impairments injected by the transmitter to this file")
+    ("seed",            po::value<uint64_t>(&opt.seed),           "Seed for the random number generators (default random)")
     ("avg-window",      po::value<nat>(&opt.avg_window),          "Size of running average window in packets")
     ("max-window",      po::value<nat>(&opt.max_window),          "Size of maximum window in packets")
     ("miss-window",     po::value<nat>(&opt.miss_window),         "Size of window for detecting lost packets")
     ("rx-buffer-size",  po::value<size_t>(&opt.rx_buf_size),      "Reception buffer size")
+    ("rx-workers",      po::value<nat>(&opt.rx_workers),          "Check and log packets in this many threads, each serving its share of the sockets (default 0, in the receiving thread)")
+    ("rcvbuf",          po::value<int>(&opt.rcvbuf),              "Socket receive buffer size (SO_RCVBUF), in bytes")
+    ("verify",          po::value<verify_mode>(&opt.verify),      "Payload verification: none, header, sampled:N or full (default)")
+    ("integrity",       po::value<payload_integrity>(&opt.integrity), "Payload integrity check, the same on both ends: pattern (default) or crc32c")
+    ("pcap",            po::value<string>(&opt.pcap_file),        "Save received packets to a pcap file")
+    ("pcap-damaged",    po::bool_switch(&opt.pcap_anomalous),     "Only save short, bad, truncated or erroneous packets")
+    ("pcap-snaplen",    po::value<size_t>(&opt.pcap_snaplen),     "Save at most this many bytes per packet, headers included")
+    ("low-latency",     po::bool_switch(&opt.low_latency),        "Pin, lock memory and busy-poll instead of sleeping")
+    ("perf-counters",   po::bool_switch(&opt.perf_counters),      "Count cycles, instructions, cache and branch misses and context switches of each packet thread, and report them with its CPU time per packet and per byte")
+    ("cpu",             po::value<int>(&opt.cpu),                 "With --low-latency, pin the sending or receiving thread to this CPU")
+    ("rt-priority",     po::value<int>(&opt.rt_priority),         "With --low-latency, use SCHED_FIFO with this priority")
+    ("busy-poll",       po::value<nat>(&opt.busy_poll),           "With --low-latency, socket busy polling time in microseconds (default 50)")
+    ("incoming-cpu",    po::bool_switch(&opt.incoming_cpu),       "Show which CPUs and NAPI instances delivered the packets of each socket and of the receiving thread")
+    ("follow-incoming-cpu", po::bool_switch(&opt.follow_incoming_cpu), "Move the receiving thread to the CPU that delivers most of its packets; implies --incoming-cpu")
+    ("control-port",    po::value<nat>(&opt.control_port),        "TCP port of the control channel used by --search-throughput")
+    ("search-throughput", po::bool_switch(&opt.search),           "Search the highest rate with losses within tolerance, for each --search-size")
+    ("search-size",     po::value< vector<nat> >(&opt.search_sizes), "Add a packet size to --search-throughput (default: RFC 2544 frame sizes)")
+    ("trial-duration",  po::value<double>(&opt.trial_duration),   "Duration of --search-throughput trials in seconds (default 2)")
+    ("loss-tolerance",  po::value<double>(&opt.loss_tolerance),   "Highest acceptable loss ratio for --search-throughput (default 0)")
+    ("loopback-bench",  po::bool_switch(&opt.bench),              "Time transmission and reception over the loopback interface for common sizes and verification modes, and write the results as JSON")
+    ("flows",           po::value<string>(&opt.flows_file),       "Send many flows listed in a file, one \"address port rate size [source_port]\" per line")
+    ("flow-range",      po::value< vector<string> >(&opt.flow_ranges), "Add one flow per address and port of a range A[-A]:P[-P]")
+    ("flow-rate",       po::value<double>(&opt.flow_rate),        "Packets per second of each --flow-range flow (default 100)")
+    ("flow-size",       po::value<size_t>(&opt.flow_size),        "Packet size of each --flow-range flow (default 1472)")
+    ("flow-stats",      po::value<string>(&opt.flow_stats_file),  "Write per-flow statistics to a CSV file")
     ("tx-src-port",     po::value<nat>(&opt.tx_src_port),         "Use a particular transmission source port")
 #if HAVE_SO_NO_CHECK
     ("no-check",        po::bool_switch(&opt.no_check),           "Disable UDP checksumming")
@@ -837,6 +2231,27 @@ int main(int argc, char* argv[])
       return 1;
     }
 
+    if(!opt.decode_log_file.empty())
+    {
+      compressed_log_reader reader(opt.decode_log_file);
+      reader.write_text(cout, thread::hardware_concurrency());
+      return 0;
+    }
+
+    if(opt.s_ips.empty()) opt.s_ips.push_back(opt.s_ip);
+    else opt.s_ip = opt.s_ips[0];
+    opt.port = opt.ports.ports[0];
+
+    if(opt.bench)
+    {
+      if(!vm.count("seed")) opt.seed = 1;
+      if(opt.log_file_suffix.empty()) opt.log_file_suffix = opt.log_format == packet_log::compressed ? ".logz" : ".log";
+      loopback_bench bench(opt.count > 0 ? opt.count : nat(default_bench_packets));
+      bench.run();
+      cout << bench << endl;
+      return 0;
+    }
+
     // Check mode
     if(!(opt.transmit || opt.receive))
     {
@@ -852,22 +2267,70 @@ int main(int argc, char* argv[])
     old_sigint_handler = std::signal(SIGINT, sigint_handler);
 
     // Setup log file
-    if(opt.log_file_suffix.empty()) opt.log_file_suffix = opt.transmit ? ".txl" : ".rxl";
+    if(opt.log_file_suffix.empty())
+    {
+      if(opt.log_granularity.bin_interval > 0) opt.log_file_suffix = opt.transmit ? ".txb" : ".rxb";
+      else
+      {
+        opt.log_file_suffix = opt.transmit ? ".txl" : ".rxl";
+        if(opt.log_format == packet_log::compressed) opt.log_file_suffix += "z";
+      }
+    }
+
+    if(!vm.count("spin"))
+    {
+      if(opt.low_latency) opt.spin = 1000;
+      else if(opt.transmit && !opt.replay_file.empty()) opt.spin = 50;
+    }
 
     if(opt.transmit)
     {
+      if(!vm.count("seed")) opt.seed = (uint64_t(random_device()()) << 32) ^ random_device()();
+      cout << "Random seed " << opt.seed << endl;
+
       po::variable_value size_v = vm["size"],
                          delay_v = vm["delay"];
       if(!size_v.empty()) opt.sizes = size_v.as< vector<distribution::ptr> >();
       if(!delay_v.empty()) opt.delays = delay_v.as< vector<distribution::ptr> >();
 
+      if(!vm.count("burst-loss")) opt.impair.loss = gilbert_elliott(opt.p_loss);
+      else if(vm.count("p-loss")) throw po::error("--p-loss and --burst-loss are exclusive; the fourth --burst-loss parameter is the loss in the good state");
+      if(opt.p_loss < 0 || opt.p_loss > 1) throw po::error("Bad --p-loss probability");
+      if(opt.impair.p_duplicate < 0 || opt.impair.p_duplicate > 1) throw po::error("Bad --duplicate probability");
+
+      if(opt.s_ips.size() > 1 || opt.ports.ports.size() > 1) throw po::error("--tx takes a single --sip and --port; see --flow-range");
+
       transmitter tx(io);
-      tx.run();
+      if(opt.search)
+      {
+        if(opt.control_port == 0) throw po::error("--search-throughput needs --control-port");
+        if(opt.search_sizes.empty())
+          opt.search_sizes.assign(default_search_sizes, default_search_sizes + sizeof(default_search_sizes) / sizeof(*default_search_sizes));
+        for(size_t k = 0; k < opt.search_sizes.size(); k ++)
+        {
+          if(opt.search_sizes[k] < packet_header::encoded_size || opt.search_sizes[k] > max_size)
+            throw po::error("Bad --search-size " + to_string(opt.search_sizes[k]));
+        }
+        tx.search_throughput();
+      }
+      else if(!opt.flows_file.empty() || !opt.flow_ranges.empty())
+      {
+        if(vm.count("burst-loss") || opt.impair.reorder.p > 0 || opt.impair.p_duplicate > 0 || opt.impair.corrupt.p > 0)
+          throw po::error("Multiple flows only support --p-loss");
+        tx.run_flows();
+      }
+      else tx.run();
     }
     else
     {
+      if(opt.follow_incoming_cpu)
+      {
+        if(vm.count("cpu")) throw po::error("--follow-incoming-cpu and --cpu are exclusive");
+        opt.incoming_cpu = true;
+      }
       receiver rx(io);
-      io.run();
+      if(opt.low_latency) rx.run_low_latency();
+      else io.run();
     }
   }
   catch(po::error& e)
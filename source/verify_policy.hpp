@@ -0,0 +1,91 @@
+// verify_policy.hpp
+//
+// Author: Berke Durak <berke.durak@gmail.com>
+// vim:set ts=2 sw=2 foldmarker={,}:
+
+#ifndef VERIFY_POLICY_HPP_20261019
+#define VERIFY_POLICY_HPP_20261019
+
+#include <string>
+
+#include "shorthands.hpp"
+
+/// Payload verification depth selected with --verify.
+struct verify_mode
+{
+  enum kind
+  {
+    none,    // Trust the header, do not check anything
+    header,  // Check the header checksum and the payload size
+    sampled, // Like header, and verify the payload of one decodable in every
+    full     // Like header, and verify every payload
+  };
+
+  kind k;
+  nat every;
+
+  verify_mode(kind k_=full, nat every_=1) : k(k_), every(every_) { }
+
+  std::string name() const
+  {
+    switch(k)
+    {
+      case none:    return "none";
+      case header:  return "header";
+      case full:    return "full";
+      case sampled: break;
+    }
+    return "sampled:" + std::to_string(every);
+  }
+};
+
+/// Payload integrity check selected with --integrity.  Both ends must use the
+/// same one.
+enum payload_integrity
+{
+  integrity_pattern, // The receiver regenerates the pseudo-random payload and compares
+  integrity_crc32c   // The payload ends with the CRC32C of the header and payload before it
+};
+
+inline const char *payload_integrity_name(payload_integrity i)
+{
+  return i == integrity_crc32c ? "crc32c" : "pattern";
+}
+
+// Verification policies.  The receive pipeline is instantiated once per
+// policy, so that checks disabled by a policy are compiled out.
+
+struct verify_none
+{
+  enum { check_header = 0, check_payload = 0 };
+  bool sample() { return false; }
+};
+
+struct verify_header
+{
+  enum { check_header = 1, check_payload = 0 };
+  bool sample() { return false; }
+};
+
+struct verify_sampled
+{
+  enum { check_header = 1, check_payload = 1 };
+  nat every, countdown;
+
+  explicit verify_sampled(nat every_) : every(every_), countdown(1) { }
+
+  bool sample()
+  {
+    if(-- countdown) return false;
+    countdown = every;
+    return true;
+  }
+};
+
+struct verify_full
+{
+  enum { check_header = 1, check_payload = 1 };
+  bool sample() { return true; }
+};
+
+#endif